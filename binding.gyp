@@ -9,7 +9,10 @@
       'sources': [
         'src/bindings.cc',
         'src/cl_checks.cc',
+        'src/commandgraph.cc',
         'src/commandqueue.cc',
+        'src/commandstream.cc',
+        'src/completion.cc',
         'src/context.cc',
         'src/device.cc',
         'src/event.cc',
@@ -38,7 +41,10 @@
           },
           'libraries': ['-framework OpenGL', '-framework OpenCL']
         }],
-        ['OS=="linux"', {'libraries': ['-lGL', '-lOpenCL']}],
+        ['OS=="linux"', {
+          'cflags_cc': ['-std=c++11'],
+          'libraries': ['-lGL', '-lOpenCL']
+        }],
         ['OS=="win"', {
           'variables' :
             {
@@ -0,0 +1,228 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// WebCLCommandStream records commands into the compact binary encoding
+// decoded by WebCLCommandQueue.submit() (see src/commandstream.h), so a
+// whole frame of commands crosses into native code in a single call.
+//
+//   var cs=new webcl.WebCLCommandStream();
+//   cs.enqueueWriteBuffer(buf, false, 0, size, data);
+//   cs.enqueueNDRangeKernel(kernel, 1, null, [n], [64]);
+//   cs.enqueueReadBuffer(buf, false, 0, size, result, event);
+//   queue.submit(cs);
+//   cs.reset(); // reuse the same storage for the next frame
+
+"use strict";
+
+var TWO_POW_32 = 4294967296;
+
+module.exports=function(cl) {
+
+function checkObjectType(obj, type) {
+  return Object.prototype.toString.call(obj) === '[object '+type+']';
+}
+
+function WebCLCommandStream(capacity) {
+  this.words=new Uint32Array(capacity || 256);
+  this.length=0;    // number of words used
+  this.objects=[];  // WebCLKernel, WebCLBuffer, WebCLEvent
+  this.hosts=[];    // ArrayBufferView
+  this.params=0;    // parameter slots used by setArg, see WebCLCommandGraph
+}
+
+WebCLCommandStream.prototype.reset=function () {
+  this.length=0;
+  this.objects.length=0;
+  this.hosts.length=0;
+  this.params=0;
+}
+
+WebCLCommandStream.prototype._reserve=function (n) {
+  if(this.length+n <= this.words.length)
+    return;
+  var size=this.words.length*2;
+  while(size < this.length+n) size*=2;
+  var words=new Uint32Array(size);
+  words.set(this.words.subarray(0, this.length));
+  this.words=words;
+}
+
+WebCLCommandStream.prototype._push=function (v) {
+  this.words[this.length++]=v;
+}
+
+// 64-bit value as two words, low word first
+WebCLCommandStream.prototype._push64=function (v) {
+  if(typeof v === 'bigint') v=Number(v);
+  if(!(v>=0 && v<=Number.MAX_SAFE_INTEGER && Math.floor(v)===v))
+    throw new TypeError('Expected an unsigned integer up to 2^53, got '+v);
+  this.words[this.length++]=v % TWO_POW_32;
+  this.words[this.length++]=Math.floor(v / TWO_POW_32);
+}
+
+function indexOf(table, obj) {
+  var i=table.indexOf(obj);
+  if(i<0) {
+    i=table.length;
+    table.push(obj);
+  }
+  return i;
+}
+
+WebCLCommandStream.prototype._object=function (obj) {
+  return indexOf(this.objects, obj);
+}
+
+WebCLCommandStream.prototype._event=function (event) {
+  if(event==null)
+    return cl.STREAM_NO_HANDLE;
+  if(!checkObjectType(event, 'WebCLEvent'))
+    throw new TypeError('Expected WebCLEvent');
+  return indexOf(this.objects, event);
+}
+
+WebCLCommandStream.prototype.enqueueNDRangeKernel=function (kernel, workDim, offsets, globals, locals, event) {
+  if (!(checkObjectType(kernel, 'WebCLKernel') && typeof workDim === 'number' &&
+      workDim>=1 && workDim<=3 && globals!=null && globals.length>=workDim &&
+      (offsets==null || offsets.length>=workDim) &&
+      (locals==null || locals.length>=workDim))) {
+    throw new TypeError('Expected WebCLCommandStream.enqueueNDRangeKernel(WebCLKernel kernel, int workDim, int[] offsets, int[] globals, int[] locals, WebCLEvent event)');
+  }
+  this._reserve(15);
+  this._push(cl.STREAM_NDRANGE_KERNEL);
+  this._push(this._event(event));
+  this._push(this._object(kernel));
+  this._push(workDim);
+  for(var i=0;i<3;i++) this._push(offsets!=null && i<workDim ? offsets[i] : 0);
+  for(var i=0;i<3;i++) this._push(i<workDim ? globals[i] : 1);
+  for(var i=0;i<3;i++) this._push(locals!=null && i<workDim ? locals[i] : 0);
+  return this;
+}
+
+WebCLCommandStream.prototype._transfer=function (op, name, buffer, blocking, offset, size, ptr, event) {
+  if (!(checkObjectType(buffer, 'WebCLBuffer') &&
+      (typeof blocking === 'boolean' || typeof blocking === 'number') &&
+      typeof ptr === 'object' && ptr!=null && typeof ptr.byteLength === 'number')) {
+    throw new TypeError('Expected WebCLCommandStream.'+name+'(WebCLBuffer buffer, boolean blocking, uint offset, uint size, ArrayBufferView ptr, WebCLEvent event)');
+  }
+  this._reserve(11);
+  this._push(op);
+  this._push(this._event(event));
+  this._push(this._object(buffer));
+  this._push(blocking ? 1 : 0);
+  this._push64(offset);
+  this._push64(size);
+  this._push(indexOf(this.hosts, ptr));
+  this._push64(0);
+  return this;
+}
+
+WebCLCommandStream.prototype.enqueueWriteBuffer=function (buffer, blocking_write, offset, sizeInBytes, ptr, event) {
+  return this._transfer(cl.STREAM_WRITE_BUFFER, 'enqueueWriteBuffer', buffer, blocking_write, offset, sizeInBytes, ptr, event);
+}
+
+WebCLCommandStream.prototype.enqueueReadBuffer=function (buffer, blocking_read, offset, sizeInBytes, ptr, event) {
+  return this._transfer(cl.STREAM_READ_BUFFER, 'enqueueReadBuffer', buffer, blocking_read, offset, sizeInBytes, ptr, event);
+}
+
+WebCLCommandStream.prototype.enqueueCopyBuffer=function (src_buffer, dst_buffer, src_offset, dst_offset, size, event) {
+  if (!(checkObjectType(src_buffer, 'WebCLBuffer') && checkObjectType(dst_buffer, 'WebCLBuffer'))) {
+    throw new TypeError('Expected WebCLCommandStream.enqueueCopyBuffer(WebCLBuffer src_buffer, WebCLBuffer dst_buffer, uint src_offset, uint dst_offset, uint size, WebCLEvent event)');
+  }
+  this._reserve(10);
+  this._push(cl.STREAM_COPY_BUFFER);
+  this._push(this._event(event));
+  this._push(this._object(src_buffer));
+  this._push(this._object(dst_buffer));
+  this._push64(src_offset);
+  this._push64(dst_offset);
+  this._push64(size);
+  return this;
+}
+
+WebCLCommandStream.prototype.enqueueBarrier=function () {
+  this._reserve(2);
+  this._push(cl.STREAM_BARRIER);
+  this._push(cl.STREAM_NO_HANDLE);
+  return this;
+}
+
+WebCLCommandStream.prototype.enqueueMarker=function (event) {
+  this._reserve(2);
+  this._push(cl.STREAM_MARKER);
+  this._push(this._event(event));
+  return this;
+}
+
+// kernel argument whose value is given when a WebCLCommandGraph is replayed
+function WebCLGraphParam(slot) {
+  if (!(typeof slot === 'number' && slot>=0 && Math.floor(slot)===slot))
+    throw new TypeError('Expected WebCLGraphParam(uint slot)');
+  this.slot=slot;
+}
+
+// value: WebCLBuffer, WebCLImage, WebCLSampler, ArrayBufferView or
+// WebCLGraphParam. Host values are read when the stream is executed, not now.
+WebCLCommandStream.prototype.setArg=function (kernel, index, value) {
+  if (!(checkObjectType(kernel, 'WebCLKernel') && typeof index === 'number' &&
+      typeof value === 'object' && value!=null)) {
+    throw new TypeError('Expected WebCLCommandStream.setArg(WebCLKernel kernel, int index, WebCLBuffer | WebCLImage | WebCLSampler | ArrayBufferView | WebCLGraphParam value)');
+  }
+  var source, v;
+  if(value instanceof WebCLGraphParam) {
+    source=cl.STREAM_ARG_PARAM;
+    v=value.slot;
+    if(v>=this.params) this.params=v+1;
+  }
+  else if(checkObjectType(value, 'WebCLBuffer') || checkObjectType(value, 'WebCLImage') ||
+          checkObjectType(value, 'WebCLSampler')) {
+    source=cl.STREAM_ARG_OBJECT;
+    v=this._object(value);
+  }
+  else if(typeof value.byteLength === 'number') {
+    source=cl.STREAM_ARG_HOST;
+    v=indexOf(this.hosts, value);
+  }
+  else
+    throw new TypeError('Expected WebCLBuffer, WebCLImage, WebCLSampler, ArrayBufferView or WebCLGraphParam');
+  this._reserve(6);
+  this._push(cl.STREAM_SET_ARG);
+  this._push(cl.STREAM_NO_HANDLE);
+  this._push(this._object(kernel));
+  this._push(index);
+  this._push(source);
+  this._push(v);
+  return this;
+}
+
+cl.WebCLGraphParam=WebCLGraphParam;
+cl.graphParam=function (slot) {
+  return new WebCLGraphParam(slot);
+}
+
+cl.WebCLCommandStream=WebCLCommandStream;
+return WebCLCommandStream;
+}
@@ -0,0 +1,241 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// WebCLDispatcher runs one NDRange across several command queues, typically
+// one per device of a multi-device context. The global range is cut into
+// chunks along its outermost dimension. Chunks are dealt to per-queue
+// deques, each queue keeps a few of its own chunks in flight, and a queue
+// that runs dry steals from the back of the fullest deque, so faster devices
+// end up doing more of the work. Scheduling is driven by chunk completion
+// events.
+//
+//   var d=new webcl.WebCLDispatcher([cpuQueue, gpuQueue]);
+//   d.enqueueNDRangeKernel(kernel, 2, null, [w, h], [16, 16], {
+//     regions: [ { buffer: out, elementSize: 4 } ]
+//   }, function(err, report) {
+//     // report.devices[i].regions: byte ranges of out written by device i
+//   });
+
+"use strict";
+
+var DEFAULT_CHUNKS_PER_QUEUE = 8;
+var DEFAULT_DEPTH = 2;   // chunks in flight per queue
+
+module.exports=function(cl) {
+
+function checkObjectType(obj, type) {
+  return Object.prototype.toString.call(obj) === '[object '+type+']';
+}
+
+function WebCLDispatcher(queues, options) {
+  if (!(Array.isArray(queues) && queues.length > 0 &&
+        queues.every(function(q) { return checkObjectType(q, 'WebCLCommandQueue'); }))) {
+    throw new TypeError('Expected WebCLDispatcher(WebCLCommandQueue[] queues, optional object options)');
+  }
+  options=options || {};
+  this.queues=queues;
+  this.chunksPerQueue=options.chunksPerQueue || DEFAULT_CHUNKS_PER_QUEUE;
+  this.depth=options.depth || DEFAULT_DEPTH;
+}
+
+// merges [offset, offset+size) into a sorted list of disjoint ranges
+function addRange(ranges, offset, size) {
+  var end=offset+size, i=0;
+  while (i < ranges.length && ranges[i].offset+ranges[i].size < offset)
+    i++;
+  var j=i;
+  while (j < ranges.length && ranges[j].offset <= end) {
+    offset=Math.min(offset, ranges[j].offset);
+    end=Math.max(end, ranges[j].offset+ranges[j].size);
+    j++;
+  }
+  ranges.splice(i, j-i, { offset: offset, size: end-offset });
+}
+
+// options:
+//   chunkSize  work-items per chunk along the outermost dimension
+//   regions    [{ buffer, elementSize, offset }]: buffers indexed by global
+//              id, elementSize bytes per work-item, to report per device
+WebCLDispatcher.prototype.enqueueNDRangeKernel=function (kernel, workDim, globalWorkOffset,
+                                                         globalWorkSize, localWorkSize,
+                                                         options, callback) {
+  if (typeof options === 'function') {
+    callback=options;
+    options=null;
+  }
+  if (!(checkObjectType(kernel, 'WebCLKernel') &&
+        typeof workDim === 'number' && workDim >= 1 && workDim <= 3 &&
+        (globalWorkOffset==null || globalWorkOffset.length >= workDim) &&
+        globalWorkSize && globalWorkSize.length >= workDim &&
+        (localWorkSize==null || localWorkSize.length >= workDim) &&
+        typeof callback === 'function')) {
+    throw new TypeError('Expected WebCLDispatcher.enqueueNDRangeKernel(WebCLKernel kernel, uint workDim, uint[] globalWorkOffset, ' +
+        'uint[] globalWorkSize, uint[] localWorkSize, optional object options, function callback)');
+  }
+  options=options || {};
+
+  var self=this, outer=workDim-1;
+  var base=[], global=[], local=null;
+  for (var i=0;i<workDim;i++) {
+    base.push(globalWorkOffset ? globalWorkOffset[i] : 0);
+    global.push(globalWorkSize[i]);
+  }
+  if (localWorkSize) {
+    local=[];
+    for (var i=0;i<workDim;i++) local.push(localWorkSize[i]);
+  }
+
+  // chunks are whole work-groups along the outermost dimension
+  var granule=local ? local[outer] : 1;
+  var range=global[outer];
+  var chunkSize=options.chunkSize ||
+                Math.ceil(range / (this.queues.length*this.chunksPerQueue));
+  chunkSize=Math.max(granule, Math.ceil(chunkSize/granule)*granule);
+
+  // bytes per step along the outermost dimension
+  var inner=1;
+  for (var i=0;i<outer;i++) inner*=global[i];
+  var regions=(options.regions || []).map(function(r) {
+    return { buffer: r.buffer, offset: r.offset || 0, stride: r.elementSize*inner };
+  });
+
+  // deal chunks round-robin so every queue starts with local work
+  var deques=this.queues.map(function() { return []; });
+  var n=0;
+  for (var start=0; start<range; start+=chunkSize, n++)
+    deques[n % deques.length].push({ start: start, size: Math.min(chunkSize, range-start) });
+
+  var devices=this.queues.map(function(queue) {
+    return {
+      queue: queue,
+      device: queue.getInfo(cl.QUEUE_DEVICE),
+      inflight: 0,
+      chunks: 0,
+      stolen: 0,
+      items: 0,
+      regions: regions.map(function(r) { return { buffer: r.buffer, ranges: [] }; })
+    };
+  });
+
+  var remaining=n, inflight=0, failed=null, finished=false;
+  var startTime=process.hrtime();
+
+  function finish() {
+    if (finished) return;
+    finished=true;
+    var diff=process.hrtime(startTime);
+    callback(failed, {
+      chunks: n,
+      chunkSize: chunkSize,
+      seconds: diff[0]+diff[1]/1e9,
+      devices: devices.map(function(d) {
+        return {
+          device: d.device,
+          queue: d.queue,
+          chunks: d.chunks,
+          stolen: d.stolen,
+          items: d.items,
+          regions: d.regions.map(function(r) { return { buffer: r.buffer, ranges: r.ranges }; })
+        };
+      })
+    });
+  }
+
+  // next chunk for queue q: its own deque first, else steal from the back
+  // of the fullest one
+  function next(q) {
+    if (deques[q].length)
+      return deques[q].shift();
+    var victim=-1;
+    for (var i=0;i<deques.length;i++)
+      if (deques[i].length && (victim<0 || deques[i].length > deques[victim].length))
+        victim=i;
+    if (victim<0)
+      return null;
+    devices[q].stolen++;
+    return deques[victim].pop();
+  }
+
+  function launch(q) {
+    var d=devices[q];
+    while (!failed && d.inflight < self.depth) {
+      var chunk=next(q);
+      if (!chunk)
+        break;
+      var offset=base.slice(), size=global.slice();
+      offset[outer]+=chunk.start;
+      size[outer]=chunk.size;
+
+      var event=new cl.WebCLEvent();
+      try {
+        d.queue.enqueueNDRangeKernel(kernel, workDim, offset, size, local, null, event);
+      }
+      catch(ex) {
+        failed=ex;
+        break;
+      }
+      d.inflight++;
+      inflight++;
+      event.setCallback(cl.COMPLETE, completed(q, chunk, event));
+    }
+    d.queue.flush();
+    if (failed && inflight===0)
+      finish();
+  }
+
+  function completed(q, chunk, event) {
+    return function(ev) {
+      var d=devices[q], status=ev.status;
+      event.release();
+      d.inflight--;
+      inflight--;
+      remaining--;
+      if (status<0 && !failed) {
+        failed=new Error('chunk failed on '+d.device.getInfo(cl.DEVICE_NAME)+' (status '+status+')');
+        failed.code=status;
+      }
+      else {
+        d.chunks++;
+        d.items+=chunk.size*inner;
+        regions.forEach(function(r, i) {
+          addRange(d.regions[i].ranges, r.offset + (base[outer]+chunk.start)*r.stride, chunk.size*r.stride);
+        });
+      }
+      if (failed ? inflight===0 : remaining===0)
+        return finish();
+      launch(q);
+    };
+  }
+
+  if (n===0)
+    return finish();
+  for (var q=0;q<devices.length;q++)
+    launch(q);
+}
+
+cl.WebCLDispatcher=WebCLDispatcher;
+
+}
@@ -0,0 +1,190 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// WebCLScheduler sends independent jobs to the least busy of a set of
+// command queues, which may be on different devices. A job is a function
+// that enqueues its commands on the queue it is given and returns the event
+// of its last command; the scheduler counts it as outstanding until that
+// event completes.
+//
+// Two policies:
+//   'least-loaded'  fewest outstanding jobs, ties go to the fastest queue
+//   'eta'           lowest estimated completion time, (outstanding + 1) jobs
+//                   at the queue's average job duration, kept per job kind.
+//
+// An in-order queue runs its jobs one after the other, so a job's service
+// time is measured from when it could start, its submission or the previous
+// completion on that queue, whichever is later, to its own completion. This
+// needs no profiling and covers every command of the job, not just the one
+// whose event is returned.
+//
+//   var s=new webcl.WebCLScheduler([q0, q1, q2], { policy: 'eta' });
+//   s.submit(function(queue) {
+//     queue.enqueueWriteBuffer(...);
+//     queue.enqueueNDRangeKernel(...);
+//     var ev=new webcl.WebCLEvent();
+//     queue.enqueueReadBuffer(..., null, ev);
+//     return ev;
+//   }, { kind: 'resize' }, function(err, queue) { ... });
+
+"use strict";
+
+var SMOOTHING = 0.2;     // weight of the newest sample in the average
+var DEFAULT_KIND = '';
+
+module.exports=function(cl) {
+
+function checkObjectType(obj, type) {
+  return Object.prototype.toString.call(obj) === '[object '+type+']';
+}
+
+function seconds(t) {
+  return t[0]+t[1]/1e9;
+}
+
+function WebCLScheduler(queues, options) {
+  if (!(Array.isArray(queues) && queues.length > 0 &&
+        queues.every(function(q) { return checkObjectType(q, 'WebCLCommandQueue'); }))) {
+    throw new TypeError('Expected WebCLScheduler(WebCLCommandQueue[] queues, optional object options)');
+  }
+  options=options || {};
+  this.policy=options.policy || 'least-loaded';
+  if (this.policy !== 'least-loaded' && this.policy !== 'eta')
+    throw new TypeError("WebCLScheduler policy must be 'least-loaded' or 'eta'");
+
+  this.lanes=queues.map(function(queue) {
+    return {
+      queue: queue,
+      lastCompletion: null,  // hrtime of the last completion
+      outstanding: 0,
+      completed: 0,
+      durations: {}    // job kind -> average seconds
+    };
+  });
+}
+
+// average job duration of lane for kind, falling back to the average of the
+// other lanes for kind, then to the average of any kinds lane has run, so a
+// kind no lane has run yet still favors the faster lanes
+WebCLScheduler.prototype._duration=function (lane, kind) {
+  if (kind in lane.durations)
+    return lane.durations[kind];
+  var sum=0, n=0;
+  this.lanes.forEach(function(l) {
+    if (kind in l.durations) { sum+=l.durations[kind]; n++; }
+  });
+  if (n)
+    return sum/n;
+  for (var k in lane.durations) {
+    sum+=lane.durations[k];
+    n++;
+  }
+  return n ? sum/n : 0;
+}
+
+WebCLScheduler.prototype._pick=function (kind) {
+  var best=null, bestCost=Infinity;
+  for (var i=0;i<this.lanes.length;i++) {
+    var lane=this.lanes[i], cost;
+    var duration=this._duration(lane, kind);
+    if (this.policy==='eta')
+      cost=(lane.outstanding+1)*duration + lane.outstanding*1e-9; // ties go to the idler lane
+    else
+      cost=lane.outstanding + duration*1e-9; // ties go to the faster lane
+    if (cost < bestCost) {
+      best=lane;
+      bestCost=cost;
+    }
+  }
+  return best;
+}
+
+// runs job(queue) on the chosen queue. callback(err, queue) is called when
+// the event returned by job completes.
+WebCLScheduler.prototype.submit=function (job, options, callback) {
+  if (typeof options === 'function') {
+    callback=options;
+    options=null;
+  }
+  if (typeof job !== 'function') {
+    throw new TypeError('Expected WebCLScheduler.submit(function job, optional object options, optional function callback)');
+  }
+  var kind=(options && options.kind) || DEFAULT_KIND;
+  var self=this, lane=this._pick(kind);
+  var submitted=process.hrtime();
+
+  var event=job(lane.queue);
+  if (!checkObjectType(event, 'WebCLEvent') && !checkObjectType(event, 'WebCLUserEvent'))
+    throw new TypeError('WebCLScheduler job must return the WebCLEvent of its last command');
+
+  lane.outstanding++;
+  event.setCallback(cl.COMPLETE, function(ev) {
+    var status=ev.status, now=process.hrtime();
+    lane.outstanding--;
+    lane.completed++;
+
+    if (status>=0) {
+      // the job started when it was submitted, or when the previous job
+      // finished if the queue was still busy then
+      var start=submitted;
+      if (lane.lastCompletion && seconds(lane.lastCompletion) > seconds(submitted))
+        start=lane.lastCompletion;
+      var service=seconds(now)-seconds(start);
+      var avg=lane.durations[kind];
+      lane.durations[kind]=(avg===undefined) ? service : avg+SMOOTHING*(service-avg);
+    }
+    lane.lastCompletion=now;
+
+    if (callback) {
+      var err=null;
+      if (status<0) {
+        err=new Error('job failed (status '+status+')');
+        err.code=status;
+      }
+      callback(err, lane.queue);
+    }
+  });
+  lane.queue.flush();
+  return lane.queue;
+}
+
+// per-queue load and history
+WebCLScheduler.prototype.stats=function () {
+  return this.lanes.map(function(lane) {
+    var durations={};
+    for (var k in lane.durations) durations[k]=lane.durations[k];
+    return {
+      queue: lane.queue,
+      outstanding: lane.outstanding,
+      completed: lane.completed,
+      durations: durations
+    };
+  });
+}
+
+cl.WebCLScheduler=WebCLScheduler;
+
+}
@@ -0,0 +1,284 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// WebCLStagingPool keeps pinned (CL_MEM_ALLOC_HOST_PTR) staging buffers for
+// host<->device transfers. Staging buffers are allocated once per power of
+// two size class, mapped once, and leased to transfers. A lease goes back to
+// its free list when the transfer event completes.
+//
+// With queue.useStagingPool(true), enqueueWriteBuffer copies the host data
+// into a leased pinned region and transfers from there, and a blocking
+// enqueueReadBuffer reads into a pinned region before copying out. That is
+// the pinned path measured by test/bandwidth.js, without each application
+// managing its own pinned buffers. Non-blocking reads bypass the pool, since
+// the copy out could only happen after their event has already completed.
+// In ticket mode, a transfer made without an event returns its ticket as
+// usual, and its lease is recycled once the queue has completed the ticket.
+//
+//   queue.useStagingPool(true);   // the context's default pool
+//   queue.enqueueWriteBuffer(buf, false, 0, size, data);
+
+"use strict";
+
+var DEFAULT_MIN_SIZE = 64*1024;
+var DEFAULT_MAX_SIZE = 64*1024*1024;
+var DEFAULT_MAX_BUFFERS = 4;   // staging buffers per size class
+
+module.exports=function(cl) {
+
+function isStageable(ptr) {
+  return Buffer.isBuffer(ptr) || ptr instanceof ArrayBuffer ||
+         (ptr != null && ptr.buffer instanceof ArrayBuffer);
+}
+
+// bytes of an ArrayBuffer or typed array as a Uint8Array sharing its memory.
+// Buffer.from copies on some runtimes and doesn't exist on others, a typed
+// array view aliases everywhere.
+function bytesOf(ptr, size) {
+  if (Buffer.isBuffer(ptr))
+    return ptr;
+  if (ptr instanceof ArrayBuffer)
+    return new Uint8Array(ptr, 0, size);
+  return new Uint8Array(ptr.buffer, ptr.byteOffset, size);
+}
+
+// copies size bytes from src to dst, each a Buffer or a Uint8Array
+function copyBytes(src, dst, size) {
+  if (Buffer.isBuffer(src) && Buffer.isBuffer(dst))
+    src.copy(dst, 0, 0, size);
+  else if (dst instanceof Uint8Array)
+    dst.set(src.length===size ? src : src.slice(0, size));
+  else {
+    // a Buffer that is no typed array, as on Node 0.10
+    for (var i=0;i<size;i++)
+      dst[i]=src[i];
+  }
+}
+
+function WebCLStagingPool(context, options) {
+  options=options || {};
+  this.context=context;
+  this.minSize=options.minSize || DEFAULT_MIN_SIZE;
+  this.maxSize=options.maxSize || DEFAULT_MAX_SIZE;
+  this.maxBuffers=options.maxBuffers || DEFAULT_MAX_BUFFERS;
+  this.free={};        // size class -> free entries
+  this.inflight={};    // size class -> entries of non-blocking transfers, oldest first
+  this.count={};       // size class -> entries allocated
+  this.leased=0;
+  this.hits=0;
+  this.misses=0;
+  this.waits=0;
+  this.bytesAllocated=0;
+}
+
+// @return the size class for size bytes, or 0 if too large to stage
+WebCLStagingPool.prototype.sizeClass=function (size) {
+  if (size > this.maxSize)
+    return 0;
+  var c=this.minSize;
+  while (c < size)
+    c*=2;
+  return c;
+}
+
+// leases a pinned region of at least size bytes, mapped with queue when
+// first allocated. When a size class has maxBuffers in use, waits for its
+// oldest transfer so pinned memory stays bounded.
+// @return the lease, or null if size is above maxSize
+WebCLStagingPool.prototype.lease=function (queue, size) {
+  var c=this.sizeClass(size);
+  if (!c)
+    return null;
+
+  var list=this.free[c] || (this.free[c]=[]);
+  var inflight=this.inflight[c] || (this.inflight[c]=[]);
+  this.count[c]=this.count[c] || 0;
+
+  for (var i=inflight.length-1;i>=0;i--) {
+    var pending=inflight[i];
+    if (pending.ticket && pending.ticket <= pending.queue.completedUpTo())
+      this._complete(pending);
+  }
+  if (!list.length && this.count[c] >= this.maxBuffers && inflight.length) {
+    var oldest=inflight[0];
+    if (oldest.ticket) {
+      try {
+        oldest.queue.waitTicket(oldest.ticket);
+      }
+      catch(ex) {
+        // a failed ticket has completed too, its queue reports the failure
+      }
+    }
+    else
+      cl.waitForEvents([oldest.event]);
+    this._complete(oldest);
+    this.waits++;
+  }
+
+  var entry=list.pop();
+  if (entry)
+    this.hits++;
+  else {
+    this.misses++;
+    var buffer=this.context.createBuffer(cl.MEM_READ_WRITE | cl.MEM_ALLOC_HOST_PTR, c);
+    var view=queue._enqueueMapBuffer(buffer, true, cl.MAP_READ | cl.MAP_WRITE, 0, c);
+    entry={ buffer: buffer, view: view, size: c, event: null, queue: null, ticket: 0 };
+    this.count[c]++;
+    this.bytesAllocated+=c;
+  }
+  this.leased++;
+  return entry;
+}
+
+// returns a leased region to its free list
+WebCLStagingPool.prototype.recycle=function (entry) {
+  this.leased--;
+  this.free[entry.size].push(entry);
+}
+
+// recycles entry once queue has completed ticket, checked on later leases
+WebCLStagingPool.prototype._recycleOnTicket=function (queue, entry, ticket) {
+  entry.queue=queue;
+  entry.ticket=ticket;
+  this.inflight[entry.size].push(entry);
+  queue.flush();
+}
+
+// recycles entry once event completes, releasing event if it is ours
+WebCLStagingPool.prototype._recycleOn=function (queue, entry, event, own) {
+  var self=this;
+  entry.event=event;
+  this.inflight[entry.size].push(entry);
+  event.setCallback(cl.COMPLETE, function() {
+    if (own) event.release();
+    // lease() may have waited for this transfer and recycled entry already
+    if (entry.event===event)
+      self._complete(entry);
+  });
+  queue.flush();
+}
+
+// the transfer using entry has completed
+WebCLStagingPool.prototype._complete=function (entry) {
+  var inflight=this.inflight[entry.size];
+  inflight.splice(inflight.indexOf(entry), 1);
+  entry.event=null;
+  entry.queue=null;
+  entry.ticket=0;
+  this.recycle(entry);
+}
+
+// stages a write through a pinned region.
+// @return null if the transfer is too large for the pool, else { result }
+// with what the enqueue returned, the ticket in ticket mode
+WebCLStagingPool.prototype.write=function (queue, buffer, blocking, offset, size, ptr, event_list, event) {
+  if (!isStageable(ptr))
+    return null;
+  var entry=this.lease(queue, size);
+  if (!entry)
+    return null;
+
+  copyBytes(bytesOf(ptr, size), entry.view, size);
+  var ticketed=!event && queue._ticketMode;
+  var ev=(blocking || ticketed) ? event : (event || new cl.WebCLEvent());
+  var result;
+  try {
+    result=queue._enqueueWriteBuffer(buffer, blocking, offset, size, entry.view, event_list, ev);
+  }
+  catch(ex) {
+    this.recycle(entry);
+    throw ex;
+  }
+  if (blocking)
+    this.recycle(entry);
+  else if (ticketed)
+    this._recycleOnTicket(queue, entry, result);
+  else
+    this._recycleOn(queue, entry, ev, !event);
+  return { result: result };
+}
+
+// reads through a pinned region, blocking reads only.
+// @return null if the transfer is not staged, else { result } as for write
+WebCLStagingPool.prototype.read=function (queue, buffer, blocking, offset, size, ptr, event_list, event) {
+  if (!blocking || !isStageable(ptr))
+    return null;
+  var entry=this.lease(queue, size);
+  if (!entry)
+    return null;
+
+  var result;
+  try {
+    result=queue._enqueueReadBuffer(buffer, true, offset, size, entry.view, event_list, event);
+    copyBytes(entry.view, bytesOf(ptr, size), size);
+  }
+  finally {
+    this.recycle(entry);
+  }
+  return { result: result };
+}
+
+// releases every free staging buffer. Leased buffers are released by
+// webcl.releaseAll() or when their context goes away.
+WebCLStagingPool.prototype.release=function () {
+  for (var c in this.free) {
+    this.free[c].forEach(function(entry) { entry.buffer.release(); });
+    this.bytesAllocated-=c*this.free[c].length;
+    this.count[c]-=this.free[c].length;
+    this.free[c].length=0;
+  }
+}
+
+WebCLStagingPool.prototype.stats=function () {
+  return {
+    leased: this.leased,
+    hits: this.hits,
+    misses: this.misses,
+    waits: this.waits,
+    bytesAllocated: this.bytesAllocated
+  };
+}
+
+cl.WebCLStagingPool=WebCLStagingPool;
+
+// the context's shared pool, created on first use
+cl.WebCLContext.prototype.getStagingPool=function (options) {
+  if (!this._stagingPool)
+    this._stagingPool=new WebCLStagingPool(this, options);
+  return this._stagingPool;
+}
+
+// routes enqueueWriteBuffer/enqueueReadBuffer of this queue through a
+// staging pool: true for the context's pool, a WebCLStagingPool, or false
+cl.WebCLCommandQueue.prototype.useStagingPool=function (pool) {
+  if (pool===true)
+    pool=this.getInfo(cl.QUEUE_CONTEXT).getStagingPool();
+  else if (pool && !(pool instanceof WebCLStagingPool))
+    throw new TypeError('Expected WebCLCommandQueue.useStagingPool(boolean or WebCLStagingPool pool)');
+  this._stagingPool=pool || null;
+}
+
+}
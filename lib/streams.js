@@ -0,0 +1,346 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Node stream adapters for WebCLBuffer transfers.
+//
+// WebCLBufferWriteStream uploads whatever is piped into it to consecutive
+// offsets of a device buffer. Incoming chunks are packed into a ring of
+// staging buffers, each full staging buffer is written with a non-blocking
+// enqueueWriteBuffer, and a staging buffer is reused only once its write
+// event has completed. Host memory stays at depth * chunkSize however large
+// the source is, and disk reads overlap host to device transfers.
+//
+//   fs.createReadStream(file)
+//     .pipe(new webcl.WebCLBufferWriteStream(queue, buffer, { chunkSize: 1<<22 }))
+//     .on('finish', function() { ... });
+//
+// WebCLBufferReadStream is the reverse: it reads a device buffer chunk by
+// chunk with non-blocking enqueueReadBuffer calls into a fixed set of depth
+// staging buffers, keeping up to depth reads in flight, so the device to
+// host transfer of the next chunks overlaps the consumer writing the current
+// one. With { map: true } chunks are mapped instead of read, the fastest path
+// on integrated and CPU devices. Either way the consumer gets a copy: piped
+// destinations may queue chunks for as long as they like, so a staging
+// buffer or mapping can't be handed out and reused.
+//
+//   new webcl.WebCLBufferReadStream(queue, buffer, { depth: 3 })
+//     .pipe(fs.createWriteStream(file));
+
+"use strict";
+
+var stream = require('stream'),
+    util = require('util');
+
+var DEFAULT_CHUNK_SIZE = 4*1024*1024;
+var DEFAULT_DEPTH = 3;
+
+module.exports=function(cl) {
+
+function makeError(status, message) {
+  var err=new Error(message+' (status '+status+')');
+  err.code=status;
+  return err;
+}
+
+// a staging buffer and the write in flight from it, if any
+function Slot(size) {
+  this.host=new Buffer(size);
+  this.used=0;
+  this.event=null;
+  this.waiting=null; // continuation run when event completes
+}
+
+function WebCLBufferWriteStream(queue, buffer, options) {
+  if (!(this instanceof WebCLBufferWriteStream))
+    return new WebCLBufferWriteStream(queue, buffer, options);
+
+  options=options || {};
+  this.chunkSize=options.chunkSize || DEFAULT_CHUNK_SIZE;
+  this.depth=options.depth || DEFAULT_DEPTH;
+  stream.Writable.call(this, { highWaterMark: this.chunkSize });
+
+  this.queue=queue;
+  this.buffer=buffer;
+  this.initialOffset=options.offset || 0;
+  this.offset=this.initialOffset;   // device offset of the current slot
+  this.position=this.initialOffset; // device offset after the last staged byte
+  this.limit=buffer.getInfo(cl.MEM_SIZE);
+  this.bytesWritten=0;              // bytes whose write has completed
+  this.slots=[];
+  for(var i=0;i<this.depth;i++)
+    this.slots.push(new Slot(this.chunkSize));
+  this.current=0;
+  this.error=null;
+  this.startTime=null;
+  this.elapsed=0;
+}
+util.inherits(WebCLBufferWriteStream, stream.Writable);
+
+// sends the current slot to the device and advances the ring
+WebCLBufferWriteStream.prototype._submit=function () {
+  var self=this, slot=this.slots[this.current], size=slot.used;
+  if (size===0)
+    return;
+
+  var event=new cl.WebCLEvent();
+  this.queue.enqueueWriteBuffer(this.buffer, false, this.offset, size, slot.host, null, event);
+  this.queue.flush();
+  this.offset+=size;
+  slot.event=event;
+  event.setCallback(cl.COMPLETE, function(ev) {
+    var status=ev.status;
+    slot.event=null;
+    slot.used=0;
+    self.bytesWritten+=size;
+    event.release();
+    if (status<0 && !self.error)
+      self.error=makeError(status, 'enqueueWriteBuffer failed');
+    var next=slot.waiting;
+    slot.waiting=null;
+    if (next) next();
+  });
+  this.current=(this.current+1) % this.slots.length;
+}
+
+// runs fn once the current slot is free to be filled
+WebCLBufferWriteStream.prototype._whenFree=function (fn) {
+  var slot=this.slots[this.current];
+  if (slot.event)
+    slot.waiting=fn;
+  else
+    fn();
+}
+
+WebCLBufferWriteStream.prototype._write=function (chunk, encoding, callback) {
+  var self=this, pos=0;
+  if (this.startTime===null)
+    this.startTime=process.hrtime();
+
+  if (this.position + chunk.length > this.limit)
+    return callback(new RangeError('write past the end of the WebCLBuffer'));
+  this.position+=chunk.length;
+
+  // fill slots until the whole chunk is staged. Completing the callback only
+  // then is what applies backpressure to the producer.
+  function fill() {
+    if (self.error)
+      return callback(self.error);
+    while (pos < chunk.length) {
+      var slot=self.slots[self.current];
+      var n=Math.min(chunk.length-pos, self.chunkSize-slot.used);
+      chunk.copy(slot.host, slot.used, pos, pos+n);
+      slot.used+=n;
+      pos+=n;
+      if (slot.used===self.chunkSize) {
+        self._submit();
+        if (self.slots[self.current].event)
+          return self._whenFree(fill);
+      }
+    }
+    callback();
+  }
+  this._whenFree(fill);
+}
+
+// sends the partial slot and waits for every write in flight
+WebCLBufferWriteStream.prototype._flushAll=function (callback) {
+  var self=this;
+  this._submit();
+
+  var remaining=0;
+  function done() {
+    if (--remaining > 0)
+      return;
+    var diff=process.hrtime(self.startTime || process.hrtime());
+    self.elapsed=diff[0]+diff[1]/1e9;
+    callback(self.error);
+  }
+  remaining++;
+  this.slots.forEach(function(slot) {
+    if (slot.event) {
+      remaining++;
+      slot.waiting=done;
+    }
+  });
+  done();
+}
+
+// Writable emits 'finish' as soon as the last chunk is staged, and the
+// streams of the Node versions this addon builds for have no _final() hook.
+// Hold 'finish' back until the tail of the stream has reached the device.
+WebCLBufferWriteStream.prototype.emit=function (name) {
+  if (name !== 'finish' || this._flushed)
+    return stream.Writable.prototype.emit.apply(this, arguments);
+
+  var self=this, args=arguments;
+  this._flushAll(function(err) {
+    self._flushed=true;
+    if (err)
+      return stream.Writable.prototype.emit.call(self, 'error', err);
+    stream.Writable.prototype.emit.apply(self, args);
+  });
+  return true;
+}
+
+// transfer statistics: bytes uploaded, seconds, and MB/s
+WebCLBufferWriteStream.prototype.stats=function () {
+  var bytes=this.bytesWritten;
+  return {
+    bytes: bytes,
+    seconds: this.elapsed,
+    throughput: this.elapsed>0 ? bytes/this.elapsed/1e6 : 0
+  };
+}
+
+cl.WebCLBufferWriteStream=WebCLBufferWriteStream;
+
+function WebCLBufferReadStream(queue, buffer, options) {
+  if (!(this instanceof WebCLBufferReadStream))
+    return new WebCLBufferReadStream(queue, buffer, options);
+
+  options=options || {};
+  this.chunkSize=options.chunkSize || DEFAULT_CHUNK_SIZE;
+  this.depth=options.depth || DEFAULT_DEPTH;
+  this.map=!!options.map;
+  // the stream buffers at most one chunk beyond the reads in flight
+  stream.Readable.call(this, { highWaterMark: this.chunkSize });
+
+  this.queue=queue;
+  this.buffer=buffer;
+  this.offset=options.offset || 0;    // device offset of the next read
+  this.limit=this.offset + (options.length !== undefined ?
+                            options.length : buffer.getInfo(cl.MEM_SIZE) - this.offset);
+  if (this.limit > buffer.getInfo(cl.MEM_SIZE))
+    throw new RangeError('read past the end of the WebCLBuffer');
+
+  // one staging buffer per read in flight, mapped reads need none
+  this.free=[];
+  for(var i=0;i<this.depth;i++)
+    this.free.push(this.map ? null : new Buffer(this.chunkSize));
+  this.inflight=[];     // reads in submission order
+  this.bytesRead=0;
+  this.wanted=false;    // consumer asked for more data
+  this.failed=false;
+  this.startTime=null;
+  this.elapsed=0;
+}
+util.inherits(WebCLBufferReadStream, stream.Readable);
+
+// copies a completed read out for the consumer and frees its slot
+WebCLBufferReadStream.prototype._takeChunk=function (read) {
+  var chunk=new Buffer(read.host.length);
+  read.host.copy(chunk);
+  if (this.map)
+    this.queue.enqueueUnmapMemObject(this.buffer, read.host);
+  this.free.push(read.slot);
+  return chunk;
+}
+
+// keeps up to depth reads in flight while the consumer wants data
+WebCLBufferReadStream.prototype._fill=function () {
+  var self=this;
+  while (this.wanted && this.free.length && this.inflight.length < this.depth &&
+         this.offset < this.limit) {
+    var size=Math.min(this.chunkSize, this.limit-this.offset);
+    var read={ slot: this.free.pop(), host: null, event: new cl.WebCLEvent(), status: null };
+    if (this.map)
+      read.host=this.queue.enqueueMapBuffer(this.buffer, false, cl.MAP_READ, this.offset, size, null, read.event);
+    else {
+      read.host=size===this.chunkSize ? read.slot : read.slot.slice(0, size);
+      this.queue.enqueueReadBuffer(this.buffer, false, this.offset, size, read.host, null, read.event);
+    }
+    this.offset+=size;
+    this.inflight.push(read);
+    read.event.setCallback(cl.COMPLETE, (function(read) {
+      return function(ev) {
+        read.status=ev.status;
+        read.event.release();
+        self._deliver();
+      };
+    })(read));
+  }
+  this.queue.flush();
+}
+
+// pushes completed reads in order
+WebCLBufferReadStream.prototype._deliver=function () {
+  if (this.failed)
+    return this._discard();
+  while (this.inflight.length && this.inflight[0].status!==null) {
+    var read=this.inflight.shift();
+    if (read.status<0) {
+      // reads still in flight complete into nothing
+      this.failed=true;
+      this.offset=this.limit;
+      this._discard();
+      return this.emit('error', makeError(read.status, this.map ? 'enqueueMapBuffer failed' : 'enqueueReadBuffer failed'));
+    }
+    this.bytesRead+=read.host.length;
+    this.wanted=this.push(this._takeChunk(read));
+  }
+
+  if (this.offset>=this.limit && this.inflight.length===0) {
+    var diff=process.hrtime(this.startTime);
+    this.elapsed=diff[0]+diff[1]/1e9;
+    this.push(null);
+  }
+  else
+    this._fill();
+}
+
+// after a failure, drops the reads that completed since, unmapping them
+WebCLBufferReadStream.prototype._discard=function () {
+  while (this.inflight.length && this.inflight[0].status!==null) {
+    var read=this.inflight.shift();
+    if (this.map && read.status>=0)
+      this.queue.enqueueUnmapMemObject(this.buffer, read.host);
+  }
+}
+
+WebCLBufferReadStream.prototype._read=function (size) {
+  if (this.failed)
+    return;
+  if (this.startTime===null)
+    this.startTime=process.hrtime();
+  this.wanted=true;
+  if (this.offset>=this.limit && this.inflight.length===0)
+    return this.push(null);
+  this._fill();
+}
+
+// transfer statistics: bytes read back, seconds, and MB/s
+WebCLBufferReadStream.prototype.stats=function () {
+  var bytes=this.bytesRead;
+  return {
+    bytes: bytes,
+    seconds: this.elapsed,
+    throughput: this.elapsed>0 ? bytes/this.elapsed/1e6 : 0
+  };
+}
+
+cl.WebCLBufferReadStream=WebCLBufferReadStream;
+
+}
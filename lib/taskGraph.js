@@ -0,0 +1,276 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// WebCLTaskGraph runs a DAG of commands with as much overlap as the queues
+// allow. Nodes declare the buffers they read and write; in the order they
+// are added, a node depends on the last writer of each buffer it reads,
+// and on the last writer and the readers since of each buffer it writes.
+// Sub-buffers count as their parent buffer, so overlapping views are
+// ordered too.
+//
+// Given one out-of-order queue, every node goes to it with the events of
+// its dependencies as wait list. Given several queues, a node continues on
+// the queue of a dependency that was the last node enqueued there, or
+// starts on the least used queue; only dependencies on other queues (or on
+// out-of-order queues) go into its wait list.
+//
+//   var g=new webcl.WebCLTaskGraph([queue]);
+//   var a=g.write(bufA, 0, size, hostA);
+//   var b=g.write(bufB, 0, size, hostB);
+//   g.kernel(blur, [n], { args: [bufA, tmpA], reads: [bufA], writes: [tmpA] });
+//   g.kernel(blur, [n], { args: [bufB, tmpB], reads: [bufB], writes: [tmpB] });
+//   g.read(tmpA, 0, size, outA);
+//   g.read(tmpB, 0, size, outB);
+//   g.run().then(function() { ... });
+
+"use strict";
+
+module.exports=function(cl) {
+
+function checkObjectType(obj, type) {
+  return Object.prototype.toString.call(obj) === '[object '+type+']';
+}
+
+function isMemory(obj) {
+  return checkObjectType(obj, 'WebCLBuffer') || checkObjectType(obj, 'WebCLImage');
+}
+
+function WebCLTaskGraph(queues) {
+  if (checkObjectType(queues, 'WebCLCommandQueue'))
+    queues=[queues];
+  if (!(Array.isArray(queues) && queues.length > 0 &&
+        queues.every(function(q) { return checkObjectType(q, 'WebCLCommandQueue'); }))) {
+    throw new TypeError('Expected WebCLTaskGraph(WebCLCommandQueue[] queues)');
+  }
+  this.lanes=queues.map(function(queue) {
+    var props=queue.getInfo(cl.QUEUE_PROPERTIES);
+    return {
+      queue: queue,
+      inOrder: !(props & cl.QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+    };
+  });
+  this.nodes=[];
+  this._access=[];    // { memory, writer, readers } per root memory object
+}
+
+// sub-buffers are tracked as their parent
+function rootOf(memory) {
+  if (memory._taskRoot===undefined) {
+    var parent=checkObjectType(memory, 'WebCLBuffer') ? memory.getInfo(cl.MEM_ASSOCIATED_MEMOBJECT) : null;
+    memory._taskRoot=parent || memory;
+  }
+  return memory._taskRoot;
+}
+
+WebCLTaskGraph.prototype._accessOf=function (memory) {
+  var root=rootOf(memory);
+  for (var i=0;i<this._access.length;i++)
+    if (this._access[i].memory===root)
+      return this._access[i];
+  var a={ memory: root, writer: null, readers: [] };
+  this._access.push(a);
+  return a;
+}
+
+// enqueue(queue, event_list, event) issues the node's command
+WebCLTaskGraph.prototype._add=function (enqueue, reads, writes, after) {
+  var node={ id: this.nodes.length, enqueue: enqueue, deps: [], event: null, lane: null };
+  var deps=node.deps;
+  function dependOn(n) {
+    if (n && n!==node && deps.indexOf(n)<0) deps.push(n);
+  }
+
+  var self=this;
+  (reads || []).forEach(function(m) {
+    if (!isMemory(m)) throw new TypeError('WebCLTaskGraph: reads must be WebCLBuffers or WebCLImages');
+    var a=self._accessOf(m);
+    dependOn(a.writer);
+    if (a.readers.indexOf(node)<0) a.readers.push(node);
+  });
+  (writes || []).forEach(function(m) {
+    if (!isMemory(m)) throw new TypeError('WebCLTaskGraph: writes must be WebCLBuffers or WebCLImages');
+    var a=self._accessOf(m);
+    dependOn(a.writer);
+    a.readers.forEach(dependOn);
+    a.writer=node;
+    a.readers=[];
+  });
+  (after || []).forEach(function(n) {
+    if (self.nodes[n.id]!==n) throw new TypeError('WebCLTaskGraph: after must list nodes of this graph');
+    dependOn(n);
+  });
+
+  this.nodes.push(node);
+  return node;
+}
+
+// globals, and options.offsets and options.locals, as for
+// enqueueNDRangeKernel. options.args are set on kernel right before it is
+// enqueued, so one kernel may appear in several nodes. Without reads and
+// writes, every buffer argument is assumed to be written.
+WebCLTaskGraph.prototype.kernel=function (kernel, globals, options) {
+  if (!(checkObjectType(kernel, 'WebCLKernel') && Array.isArray(globals) &&
+        globals.length>=1 && globals.length<=3)) {
+    throw new TypeError('Expected WebCLTaskGraph.kernel(WebCLKernel kernel, uint[] globals, optional object options)');
+  }
+  options=options || {};
+  var args=options.args, reads=options.reads, writes=options.writes;
+  if (!reads && !writes) {
+    var bound=args || kernel._memArgs || [];
+    writes=bound.filter(isMemory);
+  }
+  var offsets=options.offsets || null, locals=options.locals || null;
+  return this._add(function(queue, event_list, event) {
+    if (args)
+      for (var i=0;i<args.length;i++) kernel.setArg(i, args[i]);
+    queue.enqueueNDRangeKernel(kernel, globals.length, offsets, globals, locals, event_list, event);
+  }, reads, writes, options.after);
+}
+
+WebCLTaskGraph.prototype.write=function (buffer, offset, size, ptr, options) {
+  return this._add(function(queue, event_list, event) {
+    queue.enqueueWriteBuffer(buffer, false, offset, size, ptr, event_list, event);
+  }, null, [buffer], options && options.after);
+}
+
+WebCLTaskGraph.prototype.read=function (buffer, offset, size, ptr, options) {
+  return this._add(function(queue, event_list, event) {
+    queue.enqueueReadBuffer(buffer, false, offset, size, ptr, event_list, event);
+  }, [buffer], null, options && options.after);
+}
+
+WebCLTaskGraph.prototype.copy=function (src, dst, src_offset, dst_offset, size, options) {
+  return this._add(function(queue, event_list, event) {
+    queue.enqueueCopyBuffer(src, dst, src_offset, dst_offset, size, event_list, event);
+  }, [src], [dst], options && options.after);
+}
+
+WebCLTaskGraph.prototype.fill=function (buffer, pattern, offset, size, options) {
+  return this._add(function(queue, event_list, event) {
+    queue.enqueueFillBuffer(buffer, pattern, offset, size, event_list, event);
+  }, null, [buffer], options && options.after);
+}
+
+// any single command: enqueue(queue, event_list, event) must pass both on
+// to the enqueue call it makes
+WebCLTaskGraph.prototype.task=function (enqueue, options) {
+  if (typeof enqueue !== 'function') {
+    throw new TypeError('Expected WebCLTaskGraph.task(function enqueue, optional object options)');
+  }
+  options=options || {};
+  return this._add(enqueue, options.reads, options.writes, options.after);
+}
+
+WebCLTaskGraph.prototype._place=function (node, last, used) {
+  // continue a chain on an in-order queue, its order then covers the dependency
+  for (var i=0;i<node.deps.length;i++) {
+    var lane=node.deps[i].lane;
+    if (lane.inOrder && last[this.lanes.indexOf(lane)]===node.deps[i])
+      return lane;
+  }
+  var best=0;
+  for (var i=1;i<this.lanes.length;i++)
+    if (used[i]<used[best]) best=i;
+  return this.lanes[best];
+}
+
+// enqueues every node and flushes the queues. Returns a Promise resolved
+// when all nodes have completed, or calls callback(err) then. The node
+// events are released once the graph has completed.
+WebCLTaskGraph.prototype.run=function (callback) {
+  var lanes=this.lanes, nodes=this.nodes;
+  var last=lanes.map(function() { return null; });
+  var used=lanes.map(function() { return 0; });
+  var sinks=[];
+
+  function releaseEvents(done) {
+    nodes.forEach(function(node) {
+      if (node.event) {
+        node.event.release();
+        node.event=null;
+      }
+    });
+    if (done)
+      done.release();
+  }
+
+  var done=null;
+  try {
+    for (var n=0;n<nodes.length;n++) {
+      var node=nodes[n];
+      var lane=this._place(node, last, used);
+      var li=lanes.indexOf(lane);
+
+      var wait=[];
+      for (var i=0;i<node.deps.length;i++) {
+        var dep=node.deps[i];
+        if (!(lane.inOrder && dep.lane===lane))
+          wait.push(dep.event);
+        dep._hasSuccessor=true;
+      }
+
+      node.lane=lane;
+      node.event=new cl.WebCLEvent();
+      node._hasSuccessor=false;
+      node.enqueue(lane.queue, wait.length ? wait : null, node.event);
+      last[li]=node;
+      used[li]++;
+    }
+    nodes.forEach(function(node) {
+      if (!node._hasSuccessor) sinks.push(node.event);
+    });
+
+    done=new cl.WebCLEvent();
+    lanes[0].queue.enqueueMarker(sinks, done);
+  }
+  catch (e) {
+    // nodes enqueued so far keep running, their commands hold the events
+    lanes.forEach(function(lane) { lane.queue.flush(); });
+    releaseEvents(done);
+    throw e;
+  }
+  lanes.forEach(function(lane) { lane.queue.flush(); });
+
+  var promise=new Promise(function(resolve, reject) {
+    done.setCallback(cl.COMPLETE, function(ev) {
+      var status=ev.status;
+      releaseEvents(done);
+      if (status<0) {
+        var err=new Error('WebCLTaskGraph.run failed with error '+status);
+        err.code=status;
+        return reject(err);
+      }
+      resolve(status);
+    });
+  });
+  if (callback)
+    promise.then(function() { callback(null); }, callback);
+  return promise;
+}
+
+cl.WebCLTaskGraph=WebCLTaskGraph;
+
+}
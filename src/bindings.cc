@@ -26,7 +26,10 @@
 
 #include "webcl.h"
 
+#include "commandgraph.h"
 #include "commandqueue.h"
+#include "commandstream.h"
+#include "completion.h"
 #include "context.h"
 #include "device.h"
 #include "event.h"
@@ -121,12 +124,28 @@ void init(Handle<Object> exports)
   NODE_DEFINE_CONSTANT_VALUE(exports, "size_DOUBLE", sizeof(double));
   NODE_DEFINE_CONSTANT_VALUE(exports, "size_HALF", sizeof(float) >> 1);
 
+  // command stream opcodes (see commandstream.h)
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_NDRANGE_KERNEL", webcl::CommandStreamOp::NDRangeKernel);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_WRITE_BUFFER", webcl::CommandStreamOp::WriteBuffer);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_READ_BUFFER", webcl::CommandStreamOp::ReadBuffer);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_COPY_BUFFER", webcl::CommandStreamOp::CopyBuffer);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_BARRIER", webcl::CommandStreamOp::Barrier);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_MARKER", webcl::CommandStreamOp::Marker);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_SET_ARG", webcl::CommandStreamOp::SetArg);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_ARG_OBJECT", webcl::CommandStreamArg::Object);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_ARG_HOST", webcl::CommandStreamArg::Host);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "STREAM_ARG_PARAM", webcl::CommandStreamArg::Param);
+  exports->Set(JS_STR("STREAM_NO_HANDLE"), v8::Integer::NewFromUnsigned(webcl::STREAM_NO_HANDLE));
+
   NODE_SET_METHOD(exports, "getPlatforms", webcl::getPlatforms);
   NODE_SET_METHOD(exports, "createContext", webcl::createContext);
   NODE_SET_METHOD(exports, "waitForEvents", webcl::waitForEvents);
+  NODE_SET_METHOD(exports, "onComplete", webcl::onComplete);
   NODE_SET_METHOD(exports, "releaseAll", webcl::releaseAll);
 
+  webcl::CompletionQueue::Init();
   webcl::CommandQueue::Init(exports);
+  webcl::CommandGraph::Init(exports);
   webcl::Context::Init(exports);
   webcl::Device::Init(exports);
   webcl::Event::Init(exports);
@@ -401,6 +420,10 @@ void init(Handle<Object> exports)
 /* cl_mem_migration_flags - bitfield */
   JS_CL_CONSTANT(MIGRATE_MEM_OBJECT_HOST);
   JS_CL_CONSTANT(MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
+#else
+  // enqueueMigrateMemObjects accepts them with 1.1 headers too
+  NODE_DEFINE_CONSTANT_VALUE(exports, "MIGRATE_MEM_OBJECT_HOST", 1 << 0);
+  NODE_DEFINE_CONSTANT_VALUE(exports, "MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED", 1 << 1);
 #endif
 
   /* cl_channel_order */
@@ -1,4 +1,5 @@
 #include "cl_checks.h"
+#include <cmath>
 
 namespace webcl {
 
@@ -10,7 +11,7 @@ namespace webcl {
 /* number of bytes in the specified rectangle buffer.
  * @return -1 if error
  */
-int bufferRectSize(const size_t offset[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, size_t buffer_len)
+int64_t bufferRectSize(const size_t offset[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, size_t buffer_len)
 {
   size_t x= offset[0], y=offset[1], z=offset[2];
   size_t w=region[0], h=region[1], d=region[2];
@@ -30,14 +31,14 @@ int bufferRectSize(const size_t offset[3], const size_t region[3], size_t row_pi
   if((slice_pitch % row_pitch) !=0)
     return -1;
 
-  return (int)(z * slice_pitch + y * row_pitch + x + (w * h * d));
+  return (int64_t)(z * slice_pitch + y * row_pitch + x + (w * h * d));
 }
 
 /*
  * @return number of bytes in an image region
  * @return -1 if error
  */
-int imageRectSize(const size_t origin[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, cl_mem img, int buffer_len)
+int64_t imageRectSize(const size_t origin[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, cl_mem img, int64_t buffer_len)
 {
   size_t w = region[0], h=region[1], d=region[2];
 
@@ -58,7 +59,7 @@ int imageRectSize(const size_t origin[3], const size_t region[3], size_t row_pit
     // origin[0],origin[1],origin[2],
     // w,h,d,
     // row_pitch,slice_pitch);
-  if(buffer_len>=0 && buffer_len < (int)(region[0]*region[1]*region[2]*bpp))
+  if(buffer_len>=0 && buffer_len < (int64_t)(region[0]*region[1]*region[2]*bpp))
     return -1;
 
   if(origin[0]+region[0]>imgW || origin[1]+region[1]>imgH)
@@ -77,7 +78,7 @@ int imageRectSize(const size_t origin[3], const size_t region[3], size_t row_pit
   if(origin[0]+region[0]>imgW || origin[1]+region[1]>imgH)
     return -1;
 
-  return (int)(slice_pitch * d);
+  return (int64_t)(slice_pitch * d);
 }
 
 /*
@@ -104,7 +105,7 @@ int getTypedArrayBytes(ExternalArrayType type)
   return -1;
 }
 
-void getPtrAndLen(const Local<Value> value, void* &ptr, int &len)
+void getPtrAndLen(const Local<Value> value, void* &ptr, size_t &len)
 {
 	ptr=NULL;
 	len=0;
@@ -119,7 +120,7 @@ void getPtrAndLen(const Local<Value> value, void* &ptr, int &len)
       String::AsciiValue name(obj->GetConstructorName());
       if(!strcmp("Buffer",*name)) {
         ptr=node::Buffer::Data(obj);
-        len=(int) node::Buffer::Length(obj);
+        len=node::Buffer::Length(obj);
       }
       else {
         ptr = obj->GetIndexedPropertiesExternalArrayData();
@@ -132,6 +133,76 @@ void getPtrAndLen(const Local<Value> value, void* &ptr, int &len)
   }
 }
 
+/*
+ * Reads a byte offset or size. Any integer Number up to 2^53, the largest
+ * integer a double holds exactly, is accepted.
+ * @return false if value is not a non-negative integer in range
+ */
+// a size given as a double must be finite, integral, not negative and exact
+static bool sizeFromDouble(double v, size_t &size)
+{
+  if(!(v>=0) || v>9007199254740992.0 || v!=floor(v) || v>(double)SIZE_MAX)
+    return false;
+  size=(size_t) v;
+  return true;
+}
+
+bool getSizeValue(const Local<Value> value, size_t &size)
+{
+  if(value.IsEmpty() || !value->IsNumber())
+    return false;
+  return sizeFromDouble(value->NumberValue(), size);
+}
+
+/*
+ * Reads up to 3 work sizes (offsets, global or local sizes) from an Array,
+ * Uint32Array, Int32Array or Float64Array. Typed arrays are read directly
+ * from their backing store.
+ * @return number of values read (at most 3)
+ * @return -1 if error
+ */
+int getWorkSizes(const Local<Value> value, size_t sizes[3])
+{
+  if(value.IsEmpty() || !value->IsObject())
+    return -1;
+
+  Local<Object> obj=value->ToObject();
+  if(obj->HasIndexedPropertiesInExternalArrayData()) {
+    int n=obj->GetIndexedPropertiesExternalArrayDataLength();
+    if(n>3) n=3;
+    void *data=obj->GetIndexedPropertiesExternalArrayData();
+    switch(obj->GetIndexedPropertiesExternalArrayDataType()) {
+      case kExternalUnsignedIntArray:
+        for(int i=0;i<n;i++) sizes[i]=((const uint32_t*) data)[i];
+        return n;
+      case kExternalIntArray:
+        for(int i=0;i<n;i++) {
+          int32_t v=((const int32_t*) data)[i];
+          if(v<0) return -1;
+          sizes[i]=(size_t) v;
+        }
+        return n;
+      case kExternalDoubleArray:
+        for(int i=0;i<n;i++) {
+          if(!sizeFromDouble(((const double*) data)[i], sizes[i]))
+            return -1;
+        }
+        return n;
+      default:
+        return -1;
+    }
+  }
+
+  if(!value->IsArray())
+    return -1;
+  Local<Array> arr=Local<Array>::Cast(value);
+  int n=arr->Length();
+  if(n>3) n=3;
+  for(int i=0;i<n;i++)
+    sizes[i]=arr->Get(i)->Uint32Value();
+  return n;
+}
+
 /**
  * @return number of channels in the specified cl_channel_order
  * @return -1 if error
@@ -9,9 +9,11 @@ using namespace v8;
 
 namespace webcl {
 
-int bufferRectSize(const size_t offset[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, size_t buffer_len);
-int imageRectSize(const size_t origin[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, cl_mem img, int buffer_len=-1);
-void getPtrAndLen(const Local<Value> value, void* &ptr, int &len);
+int64_t bufferRectSize(const size_t offset[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, size_t buffer_len);
+int64_t imageRectSize(const size_t origin[3], const size_t region[3], size_t row_pitch, size_t slice_pitch, cl_mem img, int64_t buffer_len=-1);
+void getPtrAndLen(const Local<Value> value, void* &ptr, size_t &len);
+bool getSizeValue(const Local<Value> value, size_t &size);
+int getWorkSizes(const Local<Value> value, size_t sizes[3]);
 int getChannelCount(const int channelOrder);
 int getChannelSize(int channelType);
 int getTypedArrayBytes(ExternalArrayType type);
@@ -19,6 +21,16 @@ inline bool validateMemFlags(int value) {
   return (value>=CL_MEM_READ_WRITE && value<=CL_MEM_HOST_NO_ACCESS && value!=(1<<6));
 }
 
+// reads args[index] as a size_t into a new variable var, throws INVALID_VALUE
+// if it is not an integer in [0, 2^53]
+#define REQ_SIZE_ARG(index, var) \
+  size_t var=0; \
+  if(!getSizeValue(args[index], var)) { \
+    cl_int ret=CL_INVALID_VALUE; \
+    REQ_ERROR_THROW(INVALID_VALUE); \
+    NanReturnUndefined(); \
+  }
+
 } // namespace webcl
 
 #endif // CL_CHECKS_
\ No newline at end of file
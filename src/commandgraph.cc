@@ -0,0 +1,197 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "commandgraph.h"
+#include "commandqueue.h"
+#include "cl_checks.h"
+
+using namespace v8;
+using namespace node;
+
+namespace webcl {
+
+Persistent<Function> CommandGraph::constructor;
+
+void CommandGraph::Init(Handle<Object> exports)
+{
+  NanScope();
+
+  // constructor
+  Local<FunctionTemplate> ctor = FunctionTemplate::New(CommandGraph::New);
+  ctor->InstanceTemplate()->SetInternalFieldCount(1);
+  ctor->SetClassName(JS_STR("WebCLCommandGraph"));
+
+  // prototype
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_replay", replay);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_release", release);
+
+  NanAssignPersistent<Function>(constructor, ctor->GetFunction());
+  exports->Set(JS_STR("WebCLCommandGraph"), ctor->GetFunction());
+}
+
+CommandGraph::CommandGraph(Handle<Object> wrapper) : bound_(false)
+{
+}
+
+CommandGraph::~CommandGraph() {
+#ifdef LOGGING
+  printf("In ~CommandGraph\n");
+#endif
+  if(!objects_.IsEmpty()) NanDisposePersistent(objects_);
+  if(!hosts_.IsEmpty()) NanDisposePersistent(hosts_);
+}
+
+// copy of a JS array, so later changes to the recorder's tables don't reach
+// the graph
+static Local<Array> copyArray(Local<Array> src)
+{
+  Local<Array> dst = Array::New((int) src->Length());
+  for(uint32_t i=0; i<src->Length(); i++)
+    dst->Set(i, src->Get(i));
+  return dst;
+}
+
+NAN_METHOD(CommandGraph::New)
+{
+  NanScope();
+  CommandGraph *graph = new CommandGraph(args.This());
+  graph->Wrap(args.This());
+
+  void *ptr=NULL;
+  size_t len=0;
+  getPtrAndLen(args[0], ptr, len);
+  size_t num_words=args[1]->Uint32Value();
+  if(!args[2]->IsArray() || !args[3]->IsArray() ||
+     (!ptr && num_words) || num_words*sizeof(uint32_t)>len) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+  }
+
+  graph->words_.assign((const uint32_t*) ptr, (const uint32_t*) ptr + num_words);
+  Local<Array> objects=copyArray(Local<Array>::Cast(args[2]));
+  Local<Array> hosts=copyArray(Local<Array>::Cast(args[3]));
+  NanAssignPersistent(graph->objects_, objects);
+  NanAssignPersistent(graph->hosts_, hosts);
+
+  uint32_t num_params=args[4]->Uint32Value();
+  graph->params_.resize(num_params);
+
+  cl_int ret=graph->stream_.bind(graph->words_.empty() ? NULL : &graph->words_.front(),
+                                 graph->words_.size(), objects, hosts, num_params);
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_WORK_DIMENSION);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+  graph->bound_=true;
+
+  NanReturnValue(args.This());
+}
+
+NAN_METHOD(CommandGraph::replay)
+{
+  NanScope();
+  CommandGraph *graph = ObjectWrap::Unwrap<CommandGraph>(args.This());
+
+  if(!graph->bound_ || !args[0]->IsObject()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+  }
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args[0]->ToObject());
+  if(!cq->getCommandQueue()) {
+    cl_int ret=CL_INVALID_COMMAND_QUEUE;
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+  }
+
+  // new parameter values, missing ones keep the previous value
+  if(args[1]->IsArray()) {
+    Local<Array> values=Local<Array>::Cast(args[1]);
+    for(uint32_t i=0; i<values->Length() && i<graph->params_.size(); i++) {
+      Local<Value> value=values->Get(i);
+      if(value->IsUndefined() || value->IsNull())
+        continue;
+      void *ptr=NULL;
+      size_t len=0;
+      getPtrAndLen(value, ptr, len);
+      if(!ptr || !len) {
+        cl_int ret=CL_INVALID_KERNEL_ARGS;
+        REQ_ERROR_THROW(INVALID_KERNEL_ARGS);
+      }
+      graph->params_[i].assign((const char*) ptr, (const char*) ptr + len);
+    }
+  }
+
+  std::vector<HostRegion> params(graph->params_.size());
+  for(size_t i=0; i<params.size(); i++) {
+    params[i].ptr=graph->params_[i].empty() ? NULL : &graph->params_[i].front();
+    params[i].len=graph->params_[i].size();
+  }
+
+  cl_int ret=graph->stream_.execute(cq, NanNew(graph->hosts_), NULL, &params);
+
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_SAMPLER);
+    REQ_ERROR_THROW(INVALID_PROGRAM_EXECUTABLE);
+    REQ_ERROR_THROW(INVALID_KERNEL);
+    REQ_ERROR_THROW(INVALID_ARG_INDEX);
+    REQ_ERROR_THROW(INVALID_ARG_SIZE);
+    REQ_ERROR_THROW(INVALID_KERNEL_ARGS);
+    REQ_ERROR_THROW(INVALID_WORK_DIMENSION);
+    REQ_ERROR_THROW(INVALID_GLOBAL_WORK_SIZE);
+    REQ_ERROR_THROW(INVALID_WORK_GROUP_SIZE);
+    REQ_ERROR_THROW(INVALID_WORK_ITEM_SIZE);
+    REQ_ERROR_THROW(INVALID_GLOBAL_OFFSET);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
+    REQ_ERROR_THROW(MEM_COPY_OVERLAP);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandGraph::release)
+{
+  NanScope();
+  CommandGraph *graph = ObjectWrap::Unwrap<CommandGraph>(args.This());
+
+  // drops the references to the recorded objects, the graph can't be
+  // replayed anymore
+  graph->bound_=false;
+  graph->words_.clear();
+  if(!graph->objects_.IsEmpty()) NanDisposePersistent(graph->objects_);
+  if(!graph->hosts_.IsEmpty()) NanDisposePersistent(graph->hosts_);
+
+  NanReturnUndefined();
+}
+
+} // namespace webcl
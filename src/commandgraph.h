@@ -0,0 +1,74 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef COMMANDGRAPH_H_
+#define COMMANDGRAPH_H_
+
+#include "common.h"
+#include "commandstream.h"
+#include <vector>
+
+namespace webcl {
+
+// A command stream recorded once and replayed many times from native code.
+// The graph owns a copy of the stream and keeps the objects and host memory
+// it references alive. SET_ARG commands may take their value from parameter
+// slots, given at each replay; a slot keeps its value until replaced.
+class CommandGraph : public WebCLObject
+{
+
+public:
+  static void Init(v8::Handle<v8::Object> exports);
+
+  // new WebCLCommandGraph(Uint32Array words, number length, objects[],
+  //                       hosts[], number numParams)
+  static NAN_METHOD(New);
+
+  // _replay(WebCLCommandQueue queue, ArrayBufferView[] params)
+  static NAN_METHOD(replay);
+  static NAN_METHOD(release);
+
+private:
+  CommandGraph(v8::Handle<v8::Object> wrapper);
+  ~CommandGraph();
+
+  static v8::Persistent<v8::Function> constructor;
+
+  std::vector<uint32_t> words_;
+  CommandStream stream_;
+  std::vector<std::vector<char> > params_;
+  bool bound_;
+
+  v8::Persistent<v8::Array> objects_;
+  v8::Persistent<v8::Array> hosts_;
+
+private:
+  DISABLE_COPY(CommandGraph)
+};
+
+} // namespace webcl
+
+#endif // COMMANDGRAPH_H_
@@ -32,54 +32,32 @@
 #include "event.h"
 #include "kernel.h"
 #include "cl_checks.h"
+#include "commandstream.h"
+#include "completion.h"
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <node_buffer.h>
 #include <cstring> // for memcpy
+#include <cstdio>
 
 using namespace v8;
 using namespace node;
 
 namespace webcl {
 #define MakeEventWaitList(arg) \
-  cl_event *events_wait_list=NULL; \
-  cl_uint num_events_wait_list=0, num_evts=0; \
-  if(!arg->IsUndefined() && !arg->IsNull()) { \
-    Local<Array> arr = Local<Array>::Cast(arg); \
-    num_events_wait_list=arr->Length(); \
-    if(num_events_wait_list>0) {\
-      events_wait_list=new cl_event[num_events_wait_list]; \
-      for(cl_uint i=0;i<num_events_wait_list;i++) {\
-        Event *evt=ObjectWrap::Unwrap<Event>(arr->Get(i)->ToObject());\
-        /* check if this event has been deleted already */ \
-        size_t count=0; \
-        if(evt->getEvent()) { \
-          if(evt->getStatus()<0) { /* for bug in Mac driver */ \
-            cl_int ret=CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST; \
-            REQ_ERROR_THROW(EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST); \
-            NanReturnUndefined(); \
-          } \
-          cl_context ctx_ev;\
-          clGetEventInfo(evt->getEvent(),CL_EVENT_CONTEXT,sizeof(cl_context),&ctx_ev,NULL);\
-          if(ctx_ev!=ctx1) {\
-            cl_int ret=CL_INVALID_CONTEXT;\
-            REQ_ERROR_THROW(INVALID_CONTEXT);\
-            NanReturnUndefined();\
-          }\
-          clGetEventInfo(evt->getEvent(),CL_EVENT_REFERENCE_COUNT,sizeof(size_t),&count,NULL);\
-          if(count) {\
-            events_wait_list[num_evts++]=ObjectWrap::Unwrap<Event>(arr->Get(i)->ToObject())->getEvent(); \
-          }\
-        }\
-      }\
-    }\
-  }\
-  if(num_evts != num_events_wait_list) {\
-    if(events_wait_list) delete[] events_wait_list;\
-    events_wait_list=NULL;\
-    cl_int ret=CL_INVALID_EVENT_WAIT_LIST;\
-    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);\
-    NanReturnUndefined();\
-  }
+  EventWaitList wait_list; \
+  { \
+    cl_int ret=wait_list.build(arg, ctx1); \
+    if(ret!=CL_SUCCESS) { \
+      REQ_ERROR_THROW(EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST); \
+      REQ_ERROR_THROW(INVALID_CONTEXT); \
+      REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST); \
+      NanReturnUndefined(); \
+    } \
+  } \
+  cl_uint num_events_wait_list=wait_list.size(); \
+  const cl_event *events_wait_list=wait_list.data();
 
 Persistent<Function> CommandQueue::constructor;
 
@@ -102,11 +80,16 @@ void CommandQueue::Init(Handle<Object> exports)
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueWriteBufferRect", enqueueWriteBufferRect);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueReadBufferRect", enqueueReadBufferRect);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueCopyBufferRect", enqueueCopyBufferRect);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueWriteBufferScatter", enqueueWriteBufferScatter);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueReadBufferGather", enqueueReadBufferGather);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueWriteImage", enqueueWriteImage);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueReadImage", enqueueReadImage);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueCopyImage", enqueueCopyImage);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueCopyImageToBuffer", enqueueCopyImageToBuffer);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueCopyBufferToImage", enqueueCopyBufferToImage);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueFillBuffer", enqueueFillBuffer);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueFillImage", enqueueFillImage);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueMigrateMemObjects", enqueueMigrateMemObjects);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueMapBuffer", enqueueMapBuffer);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueMapImage", enqueueMapImage);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueUnmapMemObject", enqueueUnmapMemObject);
@@ -117,22 +100,48 @@ void CommandQueue::Init(Handle<Object> exports)
   NODE_SET_PROTOTYPE_METHOD(ctor, "_finish", finish);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueAcquireGLObjects", enqueueAcquireGLObjects);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_enqueueReleaseGLObjects", enqueueReleaseGLObjects);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_submit", submit);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_setFlushPolicy", setFlushPolicy);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_getFlushStats", getFlushStats);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_setTicketMode", setTicketMode);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_completedUpTo", completedUpTo);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_waitTicket", waitTicket);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_setHighWaterMark", setHighWaterMark);
+  NODE_SET_PROTOTYPE_METHOD(ctor, "_getInFlight", getInFlight);
   NODE_SET_PROTOTYPE_METHOD(ctor, "_release", release);
 
   NanAssignPersistent<Function>(constructor, ctor->GetFunction());
   exports->Set(NanNew<String>("WebCLCommandQueue"), ctor->GetFunction());
 }
 
-CommandQueue::CommandQueue(Handle<Object> wrapper) : command_queue(0)
+CommandQueue::CommandQueue(Handle<Object> wrapper) : command_queue(0), context(0), device_version(0),
+  flush_commands(0), flush_bytes(0), flush_millis(0), flush_on_wait(false),
+  pending_commands(0), pending_bytes(0), flush_timer(NULL),
+  num_flushes(0), num_auto_flushes(0),
+  staging(0), staging_size(0), staging_done(0),
+  ticket_mode(false), ticket_base(1), failed_ticket(0),
+  high_water_bytes(0), high_water_commands(0),
+  inflight_bytes(0), peak_inflight_bytes(0), inflight_commands(0), inflight_seq(0)
 {
   _type=CLObjType::CommandQueue;
 }
 
+static void OnTimerClose(uv_handle_t *handle) {
+  delete (uv_timer_t*) handle;
+}
+
 CommandQueue::~CommandQueue() {
 #ifdef LOGGING
   printf("In ~CommandQueue\n");
 #endif
   // Destructor();
+  if(flush_timer) {
+    uv_timer_stop(flush_timer);
+    flush_timer->data=NULL;
+    uv_close((uv_handle_t*) flush_timer, OnTimerClose);
+  }
+  releaseTickets();
+  releaseStaging();
 }
 
 void CommandQueue::Destructor() {
@@ -142,14 +151,368 @@ void CommandQueue::Destructor() {
 #ifdef LOGGING
     cout<<"  Destroying CommandQueue, CLrefCount is: "<<count<<endl;
 #endif
+    releaseTickets();
+    releaseStaging();
     ::clReleaseCommandQueue(command_queue);
     if(count==1) {
       unregisterCLObj(this);
       command_queue=0;
+      context=0;
     }
   }
 }
 
+#if NODE_MODULE_VERSION > 0x000B
+static void OnFlushTimer(uv_timer_t *handle)
+#else
+static void OnFlushTimer(uv_timer_t *handle, int status)
+#endif
+{
+  CommandQueue *cq=static_cast<CommandQueue*>(handle->data);
+  if(cq)
+    cq->flushPending();
+}
+
+void CommandQueue::enqueued(size_t bytes, bool blocking)
+{
+  if(blocking) {
+    resetPending();
+    return;
+  }
+
+  pending_commands++;
+  pending_bytes+=bytes;
+  if((flush_commands && pending_commands>=flush_commands) ||
+     (flush_bytes && pending_bytes>=flush_bytes)) {
+    flushPending();
+    return;
+  }
+
+  // the time budget starts with the first command after a flush
+  if(flush_millis && pending_commands==1)
+    startFlushTimer();
+}
+
+void CommandQueue::startFlushTimer()
+{
+  if(!flush_timer) {
+    flush_timer=new uv_timer_t();
+    uv_timer_init(uv_default_loop(), flush_timer);
+    uv_unref((uv_handle_t*) flush_timer);
+    flush_timer->data=this;
+  }
+  uv_timer_start(flush_timer, OnFlushTimer, flush_millis, 0);
+}
+
+void CommandQueue::flushPending()
+{
+  if(pending_commands && command_queue) {
+    ::clFlush(command_queue);
+    num_auto_flushes++;
+  }
+  resetPending();
+}
+
+void CommandQueue::resetPending()
+{
+  pending_commands=0;
+  pending_bytes=0;
+  if(flush_timer)
+    uv_timer_stop(flush_timer);
+}
+
+void CommandQueue::flushForWait(cl_event event)
+{
+  cl_command_queue queue=NULL;
+  if(!event ||
+     ::clGetEventInfo(event, CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &queue, NULL)!=CL_SUCCESS ||
+     !queue)
+    return; // user events have no queue
+
+  CommandQueue *cq=static_cast<CommandQueue*>(findCLObj((void*) queue, CLObjType::CommandQueue));
+  if(cq && cq->flush_on_wait)
+    cq->flushPending();
+}
+
+uint64_t CommandQueue::addTicket(cl_event event)
+{
+  // keep the ring short when nobody asks for completions
+  if(tickets.size()>=1024)
+    retireTickets();
+  tickets.push_back(event);
+  return ticket_base+tickets.size()-1;
+}
+
+void CommandQueue::retireTickets()
+{
+  while(!tickets.empty()) {
+    cl_int status=CL_QUEUED;
+    ::clGetEventInfo(tickets.front(), CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+    if(status>CL_COMPLETE)
+      break;
+    if(status<0 && !failed_ticket)
+      failed_ticket=ticket_base;
+    ::clReleaseEvent(tickets.front());
+    tickets.pop_front();
+    ticket_base++;
+  }
+}
+
+void CommandQueue::releaseTickets()
+{
+  while(!tickets.empty()) {
+    ::clReleaseEvent(tickets.front());
+    tickets.pop_front();
+    ticket_base++;
+  }
+}
+
+cl_mem CommandQueue::getStaging(size_t size, cl_event *done, cl_int *ret)
+{
+  *ret=CL_SUCCESS;
+  if(size>staging_size) {
+    // commands still using the old buffer keep it alive until they complete
+    size_t new_size=std::max(size, 2*staging_size);
+    cl_mem mem=::clCreateBuffer(context, CL_MEM_READ_WRITE, new_size, NULL, ret);
+    if(*ret!=CL_SUCCESS)
+      return 0;
+    if(staging) ::clReleaseMemObject(staging);
+    staging=mem;
+    staging_size=new_size;
+  }
+  *done=staging_done;
+  return staging;
+}
+
+void CommandQueue::stagingUsed(cl_event event)
+{
+  ::clRetainEvent(event);
+  if(staging_done) ::clReleaseEvent(staging_done);
+  staging_done=event;
+}
+
+void CommandQueue::releaseStaging()
+{
+  if(staging_done) ::clReleaseEvent(staging_done);
+  if(staging) ::clReleaseMemObject(staging);
+  staging_done=0;
+  staging=0;
+  staging_size=0;
+}
+
+NAN_METHOD(CommandQueue::setTicketMode)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  cq->ticket_mode=args[0]->BooleanValue();
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::completedUpTo)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  cq->retireTickets();
+  NanReturnValue(JS_NUM((double) (cq->ticket_base-1)));
+}
+
+NAN_METHOD(CommandQueue::waitTicket)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+  REQ_SIZE_ARG(0, ticket);
+  if(ticket==0 || ticket>=cq->ticket_base+cq->tickets.size()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+
+  // waits for every ticket up to this one, commands may complete out of order
+  if(ticket>=cq->ticket_base) {
+    std::vector<cl_event> events(cq->tickets.begin(), cq->tickets.begin()+(ticket-cq->ticket_base+1));
+    cq->flushPending();
+    ::clWaitForEvents((cl_uint) events.size(), &events.front());
+    cq->retireTickets();
+  }
+
+  if(cq->failed_ticket && cq->failed_ticket<=ticket) {
+    cl_int ret=CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+    REQ_ERROR_THROW(EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
+  }
+  NanReturnUndefined();
+}
+
+// a tracked host transfer: holds the host memory and the queue until the
+// command completes, then gives its bytes back on the main thread
+class InFlightTransfer : public CompletionItem {
+ public:
+  InFlightTransfer(CommandQueue *cq, uint64_t seq, Handle<Value> host) : seq_(seq) {
+    NanAssignPersistent(queue_, NanObjectWrapHandle(cq));
+    NanAssignPersistent(host_, host);
+  }
+
+  ~InFlightTransfer() {
+    NanDisposePersistent(queue_);
+    NanDisposePersistent(host_);
+  }
+
+  void Complete() {
+    NanScope();
+    Local<Object> q = NanNew(queue_);
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(q);
+    // JS resolves the pending drain() promises
+    if(cq->retired(seq_))
+      NanMakeCallback(q, "_ondrain", 0, NULL);
+  }
+
+ private:
+  uint64_t seq_;
+  Persistent<Object> queue_;
+  Persistent<Value> host_;
+};
+
+static void CL_CALLBACK InFlightCallback(cl_event event, cl_int status, void *user_data)
+{
+  // driver thread, V8 can't be used here
+  InFlightTransfer *item = static_cast<InFlightTransfer*>(user_data);
+  item->status = status;
+  CompletionQueue::Post(item);
+}
+
+void CommandQueue::track(cl_event *event, bool no_event, bool blocking, size_t bytes, Handle<Value> host)
+{
+  if(!*event || blocking)
+    return;
+
+  InFlightTransfer *item=new InFlightTransfer(this, ++inflight_seq, host);
+  CompletionQueue::Ref();
+  if(::clSetEventCallback(*event, CL_COMPLETE, InFlightCallback, item)!=CL_SUCCESS) {
+    CompletionQueue::Unref();
+    delete item;
+  }
+  else {
+    inflight[inflight_seq]=bytes;
+    inflight_bytes+=bytes;
+    inflight_commands++;
+    if(inflight_bytes>peak_inflight_bytes)
+      peak_inflight_bytes=inflight_bytes;
+  }
+
+  // the event was only needed for the callback
+  if(no_event && !ticket_mode) {
+    ::clReleaseEvent(*event);
+    *event=NULL;
+  }
+}
+
+bool CommandQueue::aboveHighWater() const
+{
+  return (high_water_bytes && inflight_bytes>=high_water_bytes) ||
+         (high_water_commands && inflight_commands>=high_water_commands);
+}
+
+bool CommandQueue::retired(uint64_t seq)
+{
+  // already retired by a finish
+  std::map<uint64_t, size_t>::iterator it=inflight.find(seq);
+  if(it==inflight.end())
+    return false;
+
+  bool above=aboveHighWater();
+  inflight_bytes-=it->second;
+  inflight_commands--;
+  inflight.erase(it);
+  return above && !aboveHighWater();
+}
+
+bool CommandQueue::retireThrough(uint64_t seq)
+{
+  bool above=aboveHighWater();
+  std::map<uint64_t, size_t>::iterator it=inflight.begin();
+  for(; it!=inflight.end() && it->first<=seq; ++it) {
+    inflight_bytes-=it->second;
+    inflight_commands--;
+  }
+  inflight.erase(inflight.begin(), it);
+  return above && !aboveHighWater();
+}
+
+NAN_METHOD(CommandQueue::setHighWaterMark)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+  // args: bytes, commands
+  size_t bytes=0;
+  if(!getSizeValue(args[0], bytes) || !args[1]->IsNumber()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+  }
+
+  // transfers already in flight stay accounted for until they complete
+  cq->high_water_bytes=bytes;
+  cq->high_water_commands=args[1]->Uint32Value();
+
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::getInFlight)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+  Local<Object> stats=NanNew<Object>();
+  stats->Set(JS_STR("bytes"), JS_NUM((double) cq->inflight_bytes));
+  stats->Set(JS_STR("commands"), JS_NUM(cq->inflight_commands));
+  stats->Set(JS_STR("peakBytes"), JS_NUM((double) cq->peak_inflight_bytes));
+  stats->Set(JS_STR("aboveHighWater"), NanNew<Boolean>(cq->aboveHighWater()));
+  NanReturnValue(stats);
+}
+
+NAN_METHOD(CommandQueue::setFlushPolicy)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+  // args: commands, bytes, milliseconds, flush on wait
+  size_t bytes=0;
+  if(!args[0]->IsNumber() || !getSizeValue(args[1], bytes) || !args[2]->IsNumber()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+  }
+
+  cq->flush_commands=args[0]->Uint32Value();
+  cq->flush_bytes=bytes;
+  cq->flush_millis=args[2]->Uint32Value();
+  cq->flush_on_wait=args[3]->BooleanValue();
+
+  // apply the new limits to what is already pending
+  uint32_t pending=cq->pending_commands;
+  if((cq->flush_commands && pending>=cq->flush_commands) ||
+     (cq->flush_bytes && cq->pending_bytes>=cq->flush_bytes))
+    cq->flushPending();
+  else if(pending && cq->flush_millis)
+    cq->startFlushTimer();
+  else if(cq->flush_timer && !cq->flush_millis)
+    uv_timer_stop(cq->flush_timer);
+
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::getFlushStats)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+  Local<Object> stats=NanNew<Object>();
+  stats->Set(JS_STR("pendingCommands"), JS_NUM(cq->pending_commands));
+  stats->Set(JS_STR("pendingBytes"), JS_NUM((double) cq->pending_bytes));
+  stats->Set(JS_STR("flushes"), JS_NUM(cq->num_flushes));
+  stats->Set(JS_STR("autoFlushes"), JS_NUM(cq->num_auto_flushes));
+  NanReturnValue(stats);
+}
+
 NAN_METHOD(CommandQueue::release)
 {
   NanScope();
@@ -238,6 +601,274 @@ NAN_METHOD(CommandQueue::getInfo)
   }
 }
 
+NAN_METHOD(CommandQueue::enqueueFillBuffer)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+
+  // check for same context (seems to be buggy in Mac driver)
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
+    cl_int ret=CL_INVALID_CONTEXT;
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    NanReturnUndefined();
+  }
+
+  void *pattern=NULL;
+  size_t pattern_size=0;
+  getPtrAndLen(args[1], pattern, pattern_size);
+
+  REQ_SIZE_ARG(2, offset);
+  REQ_SIZE_ARG(3, size);
+
+  // pattern is 1, 2, 4, ..., 128 bytes and tiles the region exactly
+  size_t len;
+  clGetMemObjectInfo(mo->getMemory(),CL_MEM_SIZE,sizeof(size_t),&len,NULL);
+  if(!pattern || pattern_size==0 || pattern_size>128 || (pattern_size & (pattern_size-1)) ||
+     size==0 || offset%pattern_size || size%pattern_size || offset+size>len) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+
+  MakeEventWaitList(args[4]);
+
+  cl_event event=NULL;
+  bool no_event = (args[5]->IsUndefined() || args[5]->IsNull());
+
+  cl_int ret=CL_SUCCESS;
+#ifdef CL_VERSION_1_2
+  if(cq->device_version>=120) {
+    ret=::clEnqueueFillBuffer(
+        cq->getCommandQueue(), mo->getMemory(),
+        pattern, pattern_size, offset, size,
+        num_events_wait_list,
+        events_wait_list,
+        cq->eventSlot(no_event, &event));
+  }
+  else
+#endif
+  {
+    // OpenCL 1.1: run a fill kernel on the device, picking the widest stores
+    // the pattern and region allow. Patterns narrower than the store are
+    // replicated.
+    Context *context=static_cast<Context*>(findCLObj((void*)ctx1, CLObjType::Context));
+    cl_mem mem=mo->getMemory();
+    cl_kernel kernel=NULL;
+    size_t unit=pattern_size;
+    unsigned char wide[128];
+    for(size_t i=0;i<sizeof(wide);i++)
+      wide[i]=((unsigned char*) pattern)[i % pattern_size];
+
+    if(!context)
+      ret=CL_INVALID_CONTEXT;
+    else if(pattern_size<=16 && offset%16==0 && size%16==0) {
+      kernel=context->getBuiltinKernel("webcl_fill_buffer16", &ret);
+      unit=16;
+      if(kernel) {
+        ret=::clSetKernelArg(kernel, 0, sizeof(cl_mem), &mem);
+        if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 1, sizeof(cl_uint4), wide);
+      }
+    }
+    else if(pattern_size<=4 && offset%4==0 && size%4==0) {
+      kernel=context->getBuiltinKernel("webcl_fill_buffer4", &ret);
+      unit=4;
+      if(kernel) {
+        ret=::clSetKernelArg(kernel, 0, sizeof(cl_mem), &mem);
+        if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 1, sizeof(cl_uint), wide);
+      }
+    }
+    else {
+      kernel=context->getBuiltinKernel("webcl_fill_buffer", &ret);
+      cl_uint arg_size=(cl_uint) pattern_size;
+      if(kernel) {
+        ret=::clSetKernelArg(kernel, 0, sizeof(cl_mem), &mem);
+        if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 1, sizeof(wide), wide);
+        if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 2, sizeof(cl_uint), &arg_size);
+      }
+    }
+
+    if(ret==CL_SUCCESS) {
+      size_t global_offset=offset/unit, global_size=size/unit;
+      ret=::clEnqueueNDRangeKernel(
+          cq->getCommandQueue(), kernel, 1,
+          &global_offset, &global_size, NULL,
+          num_events_wait_list,
+          events_wait_list,
+          cq->eventSlot(no_event, &event));
+    }
+  }
+
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
+    REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
+    REQ_ERROR_THROW(BUILD_PROGRAM_FAILURE);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+
+  // nothing crosses the bus
+  cq->enqueued(0);
+
+  if(!no_event) {
+    Event *e=ObjectWrap::Unwrap<Event>(args[5]->ToObject());
+    e->setEvent(event, ctx1);
+  }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::enqueueFillImage)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+
+  // check for same context (seems to be buggy in Mac driver)
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
+    cl_int ret=CL_INVALID_CONTEXT;
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    NanReturnUndefined();
+  }
+
+  cl_image_format format;
+  cl_int ret=::clGetImageInfo(mo->getMemory(), CL_IMAGE_FORMAT, sizeof(cl_image_format), &format, NULL);
+  if(ret!=CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+
+  // the fill color is float4, int4 or uint4 depending on the channel type,
+  // the three have the same size
+  Local<Array> colorArray = Local<Array>::Cast(args[1]);
+  cl_float colorf[4]={0,0,0,0};
+  cl_int colori[4]={0,0,0,0};
+  cl_uint colorui[4]={0,0,0,0};
+  for (uint32_t i=0; i<4 && i<colorArray->Length(); i++) {
+    Local<Value> v=colorArray->Get(i);
+    colorf[i]=(cl_float) v->NumberValue();
+    colori[i]=v->Int32Value();
+    colorui[i]=v->Uint32Value();
+  }
+
+  const void *color=colorf;
+  const char *kernel_name="webcl_fill_imagef";
+  switch(format.image_channel_data_type) {
+  case CL_SIGNED_INT8:
+  case CL_SIGNED_INT16:
+  case CL_SIGNED_INT32:
+    color=colori;
+    kernel_name="webcl_fill_imagei";
+    break;
+  case CL_UNSIGNED_INT8:
+  case CL_UNSIGNED_INT16:
+  case CL_UNSIGNED_INT32:
+    color=colorui;
+    kernel_name="webcl_fill_imageui";
+    break;
+  }
+
+  // 2D images may omit the third coordinate
+  size_t origin[3]={0,0,0};
+  size_t region[3]={1,1,1};
+
+  Local<Array> originArray = Local<Array>::Cast(args[2]);
+  for (uint32_t i=0; i<3 && i<originArray->Length(); i++) {
+    origin[i] = originArray->Get(i)->Uint32Value();
+  }
+
+  Local<Array> regionArray = Local<Array>::Cast(args[3]);
+  for (uint32_t i=0; i<3 && i<regionArray->Length(); i++) {
+    region[i] = regionArray->Get(i)->Uint32Value();
+  }
+
+  if(imageRectSize(origin,region,0,0,mo->getMemory(),-1)<0) {
+    ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+
+  MakeEventWaitList(args[4]);
+
+  cl_event event=NULL;
+  bool no_event = (args[5]->IsUndefined() || args[5]->IsNull());
+
+#ifdef CL_VERSION_1_2
+  if(cq->device_version>=120) {
+    ret=::clEnqueueFillImage(
+        cq->getCommandQueue(), mo->getMemory(),
+        color, origin, region,
+        num_events_wait_list,
+        events_wait_list,
+        cq->eventSlot(no_event, &event));
+  }
+  else
+#endif
+  {
+    // OpenCL 1.1: writing 3D images from a kernel is an extension, only 2D
+    // images are filled this way
+    cl_mem_object_type type;
+    ::clGetMemObjectInfo(mo->getMemory(), CL_MEM_TYPE, sizeof(cl_mem_object_type), &type, NULL);
+    Context *context=static_cast<Context*>(findCLObj((void*)ctx1, CLObjType::Context));
+    cl_mem mem=mo->getMemory();
+    cl_kernel kernel=NULL;
+
+    if(!context)
+      ret=CL_INVALID_CONTEXT;
+    else if(type!=CL_MEM_OBJECT_IMAGE2D)
+      ret=CL_INVALID_OPERATION;
+    else
+      kernel=context->getBuiltinKernel(kernel_name, &ret);
+
+    if(kernel) {
+      ret=::clSetKernelArg(kernel, 0, sizeof(cl_mem), &mem);
+      if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 1, sizeof(cl_float4), color);
+    }
+    if(ret==CL_SUCCESS) {
+      ret=::clEnqueueNDRangeKernel(
+          cq->getCommandQueue(), kernel, 2,
+          origin, region, NULL,
+          num_events_wait_list,
+          events_wait_list,
+          cq->eventSlot(no_event, &event));
+    }
+  }
+
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
+    REQ_ERROR_THROW(INVALID_IMAGE_SIZE);
+    REQ_ERROR_THROW(INVALID_OPERATION);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
+    REQ_ERROR_THROW(BUILD_PROGRAM_FAILURE);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+
+  cq->enqueued(0);
+
+  if(!no_event) {
+    Event *e=ObjectWrap::Unwrap<Event>(args[5]->ToObject());
+    e->setEvent(event, ctx1);
+  }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
+  NanReturnUndefined();
+}
+
 NAN_METHOD(CommandQueue::enqueueNDRangeKernel)
 {
   NanScope();
@@ -248,80 +879,78 @@ NAN_METHOD(CommandQueue::enqueueNDRangeKernel)
   Kernel *kernel = ObjectWrap::Unwrap<Kernel>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetKernelInfo(kernel->getKernel(),CL_KERNEL_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=kernel->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
   }
 
-  int workDim = args[1]->Uint32Value();
+  cl_uint workDim = args[1]->Uint32Value();
+  if(workDim<1 || workDim>3) {
+    cl_int ret=CL_INVALID_WORK_DIMENSION;
+    REQ_ERROR_THROW(INVALID_WORK_DIMENSION);
+    NanReturnUndefined();
+  }
+
+  // work sizes live on the stack, typed arrays are read in place
+  size_t offsets[3], globals[3], locals[3];
+  bool has_offsets=false, has_locals=false;
 
-  size_t *offsets=NULL;
-  cl_uint num_offsets=0;
   if(!args[2]->IsUndefined() && !args[2]->IsNull()) {
-    Local<Array> arr = Local<Array>::Cast(args[2]);
-    num_offsets=arr->Length();
-    if (num_offsets > 0) {
-      offsets = new size_t[num_offsets];
-      for (cl_uint i = 0; i < num_offsets; i++)
-        offsets[i] = arr->Get(i)->Uint32Value();
+    int n=getWorkSizes(args[2], offsets);
+    if(n>0) {
+      if(n<(int)workDim) {
+        cl_int ret=CL_INVALID_GLOBAL_OFFSET;
+        REQ_ERROR_THROW(INVALID_GLOBAL_OFFSET);
+        NanReturnUndefined();
+      }
+      has_offsets=true;
     }
-  }
-
-  size_t *globals=NULL;
-  cl_uint num_globals=0;
-  if(!args[3]->IsUndefined() && !args[3]->IsNull()) {
-    Local<Array> arr = Local<Array>::Cast(args[3]);
-    num_globals=arr->Length();
-    if(num_globals == 0) {
-      cl_int ret=CL_INVALID_GLOBAL_WORK_SIZE;
-      REQ_ERROR_THROW(INVALID_GLOBAL_WORK_SIZE);
+    else if(n<0) {
+      cl_int ret=CL_INVALID_VALUE;
+      REQ_ERROR_THROW(INVALID_VALUE);
       NanReturnUndefined();
     }
-    globals=new size_t[num_globals];
-    for(cl_uint i=0;i<num_globals;i++)
-      globals[i]=arr->Get(i)->Uint32Value();
   }
-  else {
+
+  if(getWorkSizes(args[3], globals)<(int)workDim) {
     cl_int ret=CL_INVALID_GLOBAL_WORK_SIZE;
     REQ_ERROR_THROW(INVALID_GLOBAL_WORK_SIZE);
     NanReturnUndefined();
   }
 
-  size_t *locals=NULL;
-  cl_uint num_locals=0;
   if(!args[4]->IsUndefined() && !args[4]->IsNull()) {
-    Local<Array> arr = Local<Array>::Cast(args[4]);
-    num_locals=arr->Length();
-    if(num_locals != 0) {
-      locals=new size_t[num_locals];
-      for(cl_uint i=0;i<num_locals;i++)
-        locals[i]=arr->Get(i)->Uint32Value();
+    int n=getWorkSizes(args[4], locals);
+    if(n>0) {
+      if(n<(int)workDim) {
+        cl_int ret=CL_INVALID_WORK_GROUP_SIZE;
+        REQ_ERROR_THROW(INVALID_WORK_GROUP_SIZE);
+        NanReturnUndefined();
+      }
+      has_locals=true;
+    }
+    else if(n<0) {
+      cl_int ret=CL_INVALID_VALUE;
+      REQ_ERROR_THROW(INVALID_VALUE);
+      NanReturnUndefined();
     }
   }
 
   MakeEventWaitList(args[5]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event=(args[6]->IsUndefined()  || args[6]->IsNull());
 
   cl_int ret=::clEnqueueNDRangeKernel(
       cq->getCommandQueue(), kernel->getKernel(),
       workDim, // work dimension
-      offsets,
+      has_offsets ? offsets : NULL,
       globals,
-      locals,
+      has_locals ? locals : NULL,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(offsets) delete[] offsets;
-  if(globals) delete[] globals;
-  if(locals) delete[] locals;
-  if(events_wait_list) delete[] events_wait_list;
+      cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_PROGRAM_EXECUTABLE);
@@ -344,10 +973,14 @@ NAN_METHOD(CommandQueue::enqueueNDRangeKernel)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -360,104 +993,601 @@ NAN_METHOD(CommandQueue::enqueueTask)
 
   Kernel *k = ObjectWrap::Unwrap<Kernel>(args[0]->ToObject());
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetKernelInfo(k->getKernel(),CL_KERNEL_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=k->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
+    cl_int ret=CL_INVALID_CONTEXT;
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    NanReturnUndefined();
+  }
+
+  MakeEventWaitList(args[1]);
+
+  cl_event event=NULL;
+  bool no_event = (args[2]->IsUndefined() || args[2]->IsNull());
+
+  cl_int ret=::clEnqueueTask(
+      cq->getCommandQueue(), k->getKernel(),
+      num_events_wait_list,
+      events_wait_list,
+      cq->eventSlot(no_event, &event));
+
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_PROGRAM_EXECUTABLE);
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_KERNEL);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_KERNEL_ARGS);
+    REQ_ERROR_THROW(INVALID_WORK_GROUP_SIZE);
+    REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
+    REQ_ERROR_THROW(INVALID_IMAGE_SIZE);
+    REQ_ERROR_THROW(IMAGE_FORMAT_NOT_SUPPORTED);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+
+  cq->enqueued(0);
+
+  if(!no_event) {
+    Event *e=ObjectWrap::Unwrap<Event>(args[2]->ToObject());
+    e->setEvent(event, ctx1);
+  }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::enqueueWriteBuffer)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+
+  // check for same context (seems to be buggy in Mac driver)
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
+    cl_int ret=CL_INVALID_CONTEXT;
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    NanReturnUndefined();
+  }
+
+  cl_bool blocking_write = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
+
+  REQ_SIZE_ARG(2, offset);
+  REQ_SIZE_ARG(3, size);
+
+  void *ptr=NULL;
+  size_t len=0;
+  if(args[4]->IsUndefined() || args[4]->IsNull()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+  else
+    getPtrAndLen(args[4],ptr,len);
+
+  // to overcome bug in some drivers, like Mac
+  // offset is into the device buffer, the host array only needs size bytes
+  if(len<size) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+
+  MakeEventWaitList(args[5]);
+
+  cl_event event=NULL;
+  bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
+
+  cl_int ret=::clEnqueueWriteBuffer(
+                  cq->getCommandQueue(), mo->getMemory(), blocking_write, offset, size,
+                  ptr,
+                  num_events_wait_list,
+                  events_wait_list,
+                  cq->transferEventSlot(no_event, blocking_write, &event));
+
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
+    REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
+    REQ_ERROR_THROW(EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
+    REQ_ERROR_THROW(INVALID_OPERATION);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+
+  cq->enqueued(size, blocking_write);
+  cq->track(&event, no_event, blocking_write, size, args[4]);
+
+  if(!no_event) {
+    Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
+    e->setEvent(event, ctx1);
+  }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
+  NanReturnUndefined();
+}
+
+// A (deviceOffset, hostOffset, length) transfer of a scatter/gather list
+struct TransferRange {
+  size_t device_offset, host_offset, length;
+  bool operator<(const TransferRange &other) const { return device_offset<other.device_offset; }
+};
+
+// ranges shorter than this are packed into one staging buffer and moved on
+// the device by a kernel, longer ones get a transfer of their own
+#define PACK_RANGE_LIMIT (64*1024)
+
+// lanes of the webcl_copy_ranges built-in kernel copying one range, passed
+// to it as an argument
+static const cl_uint COPY_RANGE_LANES=64;
+
+/*
+ * Reads a packed list of (deviceOffset, hostOffset, length) triples from a
+ * Uint32Array, Float64Array or Array. The ranges are sorted by device offset
+ * and ranges adjacent on both sides are merged.
+ * @return false if the list is malformed, a range is empty or out of bounds,
+ * or two ranges overlap on the side being written
+ */
+static bool getTransferRanges(const Local<Value> value, size_t buffer_len, size_t host_len,
+                              bool device_written, std::vector<TransferRange> &ranges)
+{
+  if(!value->IsObject())
+    return false;
+  Local<Object> obj=value->ToObject();
+
+  std::vector<double> values;
+  if(obj->HasIndexedPropertiesInExternalArrayData()) {
+    int n=obj->GetIndexedPropertiesExternalArrayDataLength();
+    void *data=obj->GetIndexedPropertiesExternalArrayData();
+    switch(obj->GetIndexedPropertiesExternalArrayDataType()) {
+    case kExternalUnsignedIntArray:
+      values.assign((uint32_t*) data, (uint32_t*) data + n);
+      break;
+    case kExternalDoubleArray:
+      values.assign((double*) data, (double*) data + n);
+      break;
+    default:
+      return false;
+    }
+  }
+  else if(value->IsArray()) {
+    Local<Array> arr=Local<Array>::Cast(value);
+    for(uint32_t i=0; i<arr->Length(); i++)
+      values.push_back(arr->Get(i)->NumberValue());
+  }
+  else
+    return false;
+
+  if(values.size()%3)
+    return false;
+  for(size_t i=0; i<values.size(); i++) {
+    double v=values[i];
+    if(!(v>=0) || v>9007199254740992.0 || v!=floor(v))
+      return false;
+  }
+
+  std::vector<TransferRange> list(values.size()/3);
+  for(size_t i=0; i<list.size(); i++) {
+    TransferRange &r=list[i];
+    r.device_offset=(size_t) values[3*i];
+    r.host_offset=(size_t) values[3*i+1];
+    r.length=(size_t) values[3*i+2];
+    if(r.length==0 || r.device_offset+r.length>buffer_len || r.host_offset+r.length>host_len)
+      return false;
+  }
+  std::sort(list.begin(), list.end());
+
+  ranges.clear();
+  for(size_t i=0; i<list.size(); i++) {
+    const TransferRange &r=list[i];
+    if(!ranges.empty()) {
+      TransferRange &last=ranges.back();
+      if(device_written && r.device_offset<last.device_offset+last.length)
+        return false;
+      if(last.device_offset+last.length==r.device_offset &&
+         last.host_offset+last.length==r.host_offset) {
+        last.length+=r.length;
+        continue;
+      }
+    }
+    ranges.push_back(r);
+  }
+
+  // gathers may read a device range twice but not write host bytes twice
+  if(!device_written) {
+    std::vector<std::pair<size_t,size_t> > host(ranges.size());
+    for(size_t i=0; i<ranges.size(); i++)
+      host[i]=std::make_pair(ranges[i].host_offset, ranges[i].host_offset+ranges[i].length);
+    std::sort(host.begin(), host.end());
+    for(size_t i=1; i<host.size(); i++)
+      if(host[i].first<host[i-1].second)
+        return false;
+  }
+  return true;
+}
+
+// staging memory of a non-blocking gather, copied to the host array when the
+// readback completes. Holds the host array until then, and is released on
+// the main thread.
+class GatherBaton : public CompletionItem {
+ public:
+  GatherBaton(Handle<Value> host_value) : staging(NULL), host(NULL), done(NULL) {
+    NanAssignPersistent(host_, host_value);
+  }
+
+  ~GatherBaton() {
+    NanDisposePersistent(host_);
+    delete[] staging;
+  }
+
+  void Complete() {}
+
+  unsigned char *staging;
+  unsigned char *host;
+  std::vector<TransferRange> ranges;
+  std::vector<size_t> staging_offsets;
+  cl_event done;
+
+ private:
+  Persistent<Value> host_;
+};
+
+static void CL_CALLBACK GatherComplete(cl_event event, cl_int status, void *user_data)
+{
+  // driver thread, the host array is kept alive by the baton
+  GatherBaton *baton=static_cast<GatherBaton*>(user_data);
+  if(status==CL_COMPLETE) {
+    for(size_t i=0; i<baton->ranges.size(); i++)
+      memcpy(baton->host+baton->ranges[i].host_offset, baton->staging+baton->staging_offsets[i], baton->ranges[i].length);
+  }
+  ::clSetUserEventStatus(baton->done, status==CL_COMPLETE ? CL_COMPLETE : (status<0 ? status : CL_OUT_OF_RESOURCES));
+  ::clReleaseEvent(baton->done);
+  ::clReleaseEvent(event);
+  CompletionQueue::Post(baton);
+}
+
+// frees the host copy of a scatter's packed ranges once it is uploaded
+static void CL_CALLBACK UploadComplete(cl_event event, cl_int status, void *user_data)
+{
+  delete[] static_cast<unsigned char*>(user_data);
+}
+
+/*
+ * Moves the small ranges of a scatter or gather through the queue's staging
+ * buffer: a single upload and a copy kernel for writes, an upload of the
+ * range table, a copy kernel and a single readback for reads. Appends the
+ * events to wait for to parts.
+ */
+static cl_int enqueuePackedRanges(CommandQueue *cq, cl_mem mem, bool write,
+                                  const std::vector<TransferRange> &ranges,
+                                  unsigned char *host, Handle<Value> host_value,
+                                  bool blocking, cl_uint num_events_wait_list, const cl_event *events_wait_list,
+                                  std::vector<cl_event> &parts)
+{
+  cl_context ctx=cq->getContext();
+  Context *context=static_cast<Context*>(findCLObj((void*)ctx, CLObjType::Context));
+  if(!context)
+    return CL_INVALID_CONTEXT;
+  cl_int ret=CL_SUCCESS;
+  cl_kernel kernel=context->getBuiltinKernel("webcl_copy_ranges", &ret);
+  if(!kernel)
+    return ret;
+
+  // staging layout: a table of (dst, src, length) ulongs, then the data
+  size_t count=ranges.size();
+  size_t table_size=count*3*sizeof(cl_ulong);
+  size_t total=table_size;
+  std::vector<size_t> staging_offsets(count);
+  for(size_t i=0; i<count; i++) {
+    staging_offsets[i]=total;
+    total+=ranges[i].length;
+  }
+
+  cl_event last_use=NULL;
+  cl_mem tmp=cq->getStaging(total, &last_use, &ret);
+  if(!tmp)
+    return ret;
+
+  unsigned char *staging=new unsigned char[total];
+  cl_ulong *table=(cl_ulong*) staging;
+  for(size_t i=0; i<count; i++) {
+    const TransferRange &r=ranges[i];
+    table[3*i]  =write ? r.device_offset : staging_offsets[i];
+    table[3*i+1]=write ? staging_offsets[i] : r.device_offset;
+    table[3*i+2]=r.length;
+    if(write)
+      memcpy(staging+staging_offsets[i], host+r.host_offset, r.length);
+  }
+
+  // a write uploads the table and the data, a read only the table. Either
+  // waits until the previous user of the staging buffer is done with it.
+  cl_event uploaded=NULL;
+  ret=::clEnqueueWriteBuffer(cq->getCommandQueue(), tmp, CL_FALSE, 0, write ? total : table_size,
+                             staging, last_use ? 1 : 0, last_use ? &last_use : NULL, &uploaded);
+  if(ret!=CL_SUCCESS) {
+    delete[] staging;
+    return ret;
+  }
+
+  std::vector<cl_event> wait(events_wait_list, events_wait_list+num_events_wait_list);
+  wait.push_back(uploaded);
+
+  cl_uint arg_count=(cl_uint) count;
+  cl_mem dst=write ? mem : tmp, src=write ? tmp : mem;
+  ret=::clSetKernelArg(kernel, 0, sizeof(cl_mem), &dst);
+  if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 1, sizeof(cl_mem), &src);
+  if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 2, sizeof(cl_mem), &tmp);
+  if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 3, sizeof(cl_uint), &arg_count);
+  if(ret==CL_SUCCESS) ret=::clSetKernelArg(kernel, 4, sizeof(cl_uint), &COPY_RANGE_LANES);
+
+  cl_event copied=NULL;
+  size_t global=count*COPY_RANGE_LANES;
+  if(ret==CL_SUCCESS)
+    ret=::clEnqueueNDRangeKernel(cq->getCommandQueue(), kernel, 1, NULL, &global, NULL,
+                                 (cl_uint) wait.size(), &wait.front(), &copied);
+
+  // the table (and the data of a write) must stay in staging until uploaded
+  if(::clSetEventCallback(uploaded, CL_COMPLETE, UploadComplete, write ? staging : NULL)!=CL_SUCCESS) {
+    ::clWaitForEvents(1, &uploaded);
+    if(write) delete[] staging;
+  }
+  if(ret!=CL_SUCCESS) {
+    cq->stagingUsed(uploaded);
+    if(!write) {
+      // the table is uploaded from staging
+      ::clWaitForEvents(1, &uploaded);
+      delete[] staging;
+    }
+    ::clReleaseEvent(uploaded);
+    return ret;
+  }
+  ::clReleaseEvent(uploaded);
+
+  if(write) {
+    cq->stagingUsed(copied);
+    parts.push_back(copied);
+    return CL_SUCCESS;
+  }
+
+  // read the packed data back, in place in staging after the table
+  cl_event read=NULL;
+  ret=::clEnqueueReadBuffer(cq->getCommandQueue(), tmp, blocking ? CL_TRUE : CL_FALSE,
+                            table_size, total-table_size, staging+table_size,
+                            1, &copied, &read);
+  if(ret!=CL_SUCCESS) {
+    cq->stagingUsed(copied);
+    ::clWaitForEvents(1, &copied);
+    ::clReleaseEvent(copied);
+    delete[] staging;
+    return ret;
+  }
+  ::clReleaseEvent(copied);
+  cq->stagingUsed(read);
+
+  if(blocking) {
+    for(size_t i=0; i<count; i++)
+      memcpy(host+ranges[i].host_offset, staging+staging_offsets[i], ranges[i].length);
+    delete[] staging;
+    parts.push_back(read);
+    return CL_SUCCESS;
+  }
+
+  // unpacked by the completion callback, a user event stands for the whole
+  GatherBaton *baton=new GatherBaton(host_value);
+  baton->staging=staging;
+  baton->host=host;
+  baton->ranges=ranges;
+  baton->staging_offsets=staging_offsets;
+  baton->done=::clCreateUserEvent(ctx, &ret);
+  if(ret!=CL_SUCCESS) {
+    ::clWaitForEvents(1, &read);
+    ::clReleaseEvent(read);
+    delete baton;
+    return ret;
+  }
+  ::clRetainEvent(baton->done);
+  parts.push_back(baton->done);
+  CompletionQueue::Ref();
+  ret=::clSetEventCallback(read, CL_COMPLETE, GatherComplete, baton);
+  if(ret!=CL_SUCCESS) {
+    // no callback, finish the job here
+    ::clWaitForEvents(1, &read);
+    GatherComplete(read, CL_COMPLETE, baton);
+    ret=CL_SUCCESS;
+  }
+  return ret;
+}
+
+/*
+ * Enqueues a scatter (write) or gather (read) of ranges between mem and
+ * host. Long ranges get a transfer each, short ones are packed. On success
+ * event, if given, receives one event for the whole operation.
+ */
+static cl_int enqueueTransferRanges(CommandQueue *cq, cl_mem mem, bool write,
+                                    const std::vector<TransferRange> &ranges,
+                                    unsigned char *host, Handle<Value> host_value,
+                                    bool blocking, cl_uint num_events_wait_list, const cl_event *events_wait_list,
+                                    cl_event *event)
+{
+  std::vector<cl_event> parts;
+  std::vector<TransferRange> packed;
+  cl_int ret=CL_SUCCESS;
+
+  for(size_t i=0; i<ranges.size() && ret==CL_SUCCESS; i++) {
+    const TransferRange &r=ranges[i];
+    if(r.length<PACK_RANGE_LIMIT) {
+      packed.push_back(r);
+      continue;
+    }
+    cl_event part=NULL;
+    if(write)
+      ret=::clEnqueueWriteBuffer(cq->getCommandQueue(), mem, CL_FALSE, r.device_offset, r.length,
+                                 host+r.host_offset, num_events_wait_list, events_wait_list, &part);
+    else
+      ret=::clEnqueueReadBuffer(cq->getCommandQueue(), mem, CL_FALSE, r.device_offset, r.length,
+                                host+r.host_offset, num_events_wait_list, events_wait_list, &part);
+    if(ret==CL_SUCCESS)
+      parts.push_back(part);
+  }
+
+  // a kernel is not worth it for a single short range
+  if(ret==CL_SUCCESS && packed.size()==1) {
+    const TransferRange &r=packed[0];
+    cl_event part=NULL;
+    if(write)
+      ret=::clEnqueueWriteBuffer(cq->getCommandQueue(), mem, CL_FALSE, r.device_offset, r.length,
+                                 host+r.host_offset, num_events_wait_list, events_wait_list, &part);
+    else
+      ret=::clEnqueueReadBuffer(cq->getCommandQueue(), mem, CL_FALSE, r.device_offset, r.length,
+                                host+r.host_offset, num_events_wait_list, events_wait_list, &part);
+    if(ret==CL_SUCCESS)
+      parts.push_back(part);
+  }
+  else if(ret==CL_SUCCESS && packed.size()>1)
+    ret=enqueuePackedRanges(cq, mem, write, packed, host, host_value, blocking,
+                            num_events_wait_list, events_wait_list, parts);
+
+  if(ret==CL_SUCCESS && blocking && !parts.empty())
+    ret=::clWaitForEvents((cl_uint) parts.size(), &parts.front());
+
+  if(ret==CL_SUCCESS && event) {
+    if(parts.size()==1) {
+      *event=parts[0];
+      parts.clear();
+    }
+    else if(parts.empty())
+      ret=cq->enqueueJoin(false, num_events_wait_list, events_wait_list, event);
+    else
+      ret=cq->enqueueJoin(false, (cl_uint) parts.size(), &parts.front(), event);
+  }
+
+  // a packed gather completes through a user event set by the readback's
+  // callback. Submit the readback, and the join waiting on it, now: nothing
+  // else may flush the queue before the caller waits on the event.
+  if(ret==CL_SUCCESS && !write && !blocking && packed.size()>1) {
+    ret=::clFlush(cq->getCommandQueue());
+    if(ret!=CL_SUCCESS && event && *event) {
+      ::clReleaseEvent(*event);
+      *event=NULL;
+    }
+  }
+
+  for(size_t i=0; i<parts.size(); i++)
+    ::clReleaseEvent(parts[i]);
+  return ret;
+}
+
+NAN_METHOD(CommandQueue::enqueueWriteBufferScatter)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+
+  // check for same context (seems to be buggy in Mac driver)
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
   }
 
-  MakeEventWaitList(args[1]);
-
-  cl_event event;
-  bool no_event = (args[2]->IsUndefined() || args[2]->IsNull());
+  bool blocking_write = args[1]->BooleanValue();
+
+  void *ptr=NULL;
+  size_t len=0, buffer_len=0;
+  getPtrAndLen(args[3], ptr, len);
+  clGetMemObjectInfo(mo->getMemory(),CL_MEM_SIZE,sizeof(size_t),&buffer_len,NULL);
+
+  std::vector<TransferRange> ranges;
+  if(!ptr || !getTransferRanges(args[2], buffer_len, len, true, ranges)) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+
+  MakeEventWaitList(args[4]);
 
-  cl_int ret=::clEnqueueTask(
-      cq->getCommandQueue(), k->getKernel(),
-      num_events_wait_list,
-      events_wait_list,
-      no_event ? NULL : &event);
+  cl_event event=NULL;
+  bool no_event = (args[5]->IsUndefined() || args[5]->IsNull());
 
-  if(events_wait_list) delete[] events_wait_list;
+  cl_int ret=enqueueTransferRanges(cq, mo->getMemory(), true, ranges, (unsigned char*) ptr, args[3],
+                                   blocking_write, num_events_wait_list, events_wait_list,
+                                   cq->transferEventSlot(no_event, blocking_write, &event));
 
   if (ret != CL_SUCCESS) {
-    REQ_ERROR_THROW(INVALID_PROGRAM_EXECUTABLE);
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
-    REQ_ERROR_THROW(INVALID_KERNEL);
     REQ_ERROR_THROW(INVALID_CONTEXT);
-    REQ_ERROR_THROW(INVALID_KERNEL_ARGS);
-    REQ_ERROR_THROW(INVALID_WORK_GROUP_SIZE);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
     REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
-    REQ_ERROR_THROW(INVALID_IMAGE_SIZE);
-    REQ_ERROR_THROW(IMAGE_FORMAT_NOT_SUPPORTED);
+    REQ_ERROR_THROW(EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
     REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
+    REQ_ERROR_THROW(BUILD_PROGRAM_FAILURE);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
     REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
-    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  size_t bytes=0;
+  for(size_t i=0; i<ranges.size(); i++)
+    bytes+=ranges[i].length;
+  cq->enqueued(bytes, blocking_write);
+  cq->track(&event, no_event, blocking_write, bytes, args[3]);
+
   if(!no_event) {
-    Event *e=ObjectWrap::Unwrap<Event>(args[2]->ToObject());
-    e->setEvent(event);
+    Event *e=ObjectWrap::Unwrap<Event>(args[5]->ToObject());
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
-NAN_METHOD(CommandQueue::enqueueWriteBuffer)
+NAN_METHOD(CommandQueue::enqueueReadBufferGather)
 {
   NanScope();
   CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
   }
 
-  cl_bool blocking_write = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
-
-  uint32_t offset = args[2]->Uint32Value();
-  uint32_t size = args[3]->Uint32Value();
+  bool blocking_read = args[1]->BooleanValue();
 
   void *ptr=NULL;
-  int len=0;
-  if(args[4]->IsUndefined() || args[4]->IsNull()) {
-    cl_int ret=CL_INVALID_VALUE;
-    REQ_ERROR_THROW(INVALID_VALUE);
-    NanReturnUndefined();
-  }
-  else
-    getPtrAndLen(args[4],ptr,len);
+  size_t len=0, buffer_len=0;
+  getPtrAndLen(args[3], ptr, len);
+  clGetMemObjectInfo(mo->getMemory(),CL_MEM_SIZE,sizeof(size_t),&buffer_len,NULL);
 
-  // to overcome bug in some drivers, like Mac
-  // printf("len %lu, offset %d, size %d\n",len,offset,size);
-  if(len< (int)(size+offset)) {
+  std::vector<TransferRange> ranges;
+  if(!ptr || !getTransferRanges(args[2], buffer_len, len, false, ranges)) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
     NanReturnUndefined();
   }
 
-  MakeEventWaitList(args[5]);
-
-  cl_event event;
-  bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
+  MakeEventWaitList(args[4]);
 
-  cl_int ret=::clEnqueueWriteBuffer(
-                  cq->getCommandQueue(), mo->getMemory(), blocking_write, offset, size,
-                  ptr,
-                  num_events_wait_list,
-                  events_wait_list,
-                  no_event ? NULL : &event);
+  cl_event event=NULL;
+  bool no_event = (args[5]->IsUndefined() || args[5]->IsNull());
 
-  if(events_wait_list) delete[] events_wait_list;
+  cl_int ret=enqueueTransferRanges(cq, mo->getMemory(), false, ranges, (unsigned char*) ptr, args[3],
+                                   blocking_read, num_events_wait_list, events_wait_list,
+                                   cq->transferEventSlot(no_event, blocking_read, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -468,16 +1598,24 @@ NAN_METHOD(CommandQueue::enqueueWriteBuffer)
     REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
     REQ_ERROR_THROW(EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
     REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
-    REQ_ERROR_THROW(INVALID_OPERATION);
+    REQ_ERROR_THROW(BUILD_PROGRAM_FAILURE);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
     REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  size_t bytes=0;
+  for(size_t i=0; i<ranges.size(); i++)
+    bytes+=ranges[i].length;
+  cq->enqueued(bytes, blocking_read);
+  cq->track(&event, no_event, blocking_read, bytes, args[3]);
+
   if(!no_event) {
-    Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    Event *e=ObjectWrap::Unwrap<Event>(args[5]->ToObject());
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -488,10 +1626,8 @@ NAN_METHOD(CommandQueue::enqueueWriteBufferRect)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -522,7 +1658,7 @@ NAN_METHOD(CommandQueue::enqueueWriteBufferRect)
   uint32_t host_slice_pitch=args[8]->Uint32Value();
 
   void *ptr=NULL;
-  int len=0;
+  size_t len=0;
   if(args[9]->IsUndefined() || args[9]->IsNull()) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -531,10 +1667,9 @@ NAN_METHOD(CommandQueue::enqueueWriteBufferRect)
   else
     getPtrAndLen(args[9],ptr,len);
 
-  int buf_sz = bufferRectSize(buffer_origin, region, buffer_row_pitch, buffer_slice_pitch, len);
-  int host_sz = bufferRectSize(host_origin, region, host_row_pitch, host_slice_pitch, len);
-  // printf("len %d, buf off %d, host off %d\n",len,buf_sz,host_sz);
-  if (buf_sz < 0 || host_sz < 0 || buf_sz > len || host_sz > len)
+  int64_t buf_sz = bufferRectSize(buffer_origin, region, buffer_row_pitch, buffer_slice_pitch, len);
+  int64_t host_sz = bufferRectSize(host_origin, region, host_row_pitch, host_slice_pitch, len);
+  if (buf_sz < 0 || host_sz < 0 || buf_sz > (int64_t) len || host_sz > (int64_t) len)
   {
     cl_int ret = CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -543,7 +1678,7 @@ NAN_METHOD(CommandQueue::enqueueWriteBufferRect)
 
   MakeEventWaitList(args[10]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[11]->IsUndefined() || args[11]->IsNull());
 
   cl_int ret=::clEnqueueWriteBufferRect(
@@ -560,9 +1695,7 @@ NAN_METHOD(CommandQueue::enqueueWriteBufferRect)
       ptr,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->transferEventSlot(no_event, blocking_write, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -579,10 +1712,15 @@ NAN_METHOD(CommandQueue::enqueueWriteBufferRect)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(region[0]*region[1]*region[2], blocking_write);
+  cq->track(&event, no_event, blocking_write, region[0]*region[1]*region[2], args[9]);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[11]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -593,10 +1731,8 @@ NAN_METHOD(CommandQueue::enqueueReadBuffer)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -604,11 +1740,11 @@ NAN_METHOD(CommandQueue::enqueueReadBuffer)
 
   cl_bool blocking_read = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
 
-  uint32_t offset=args[2]->Uint32Value();
-  uint32_t size=args[3]->Uint32Value();
+  REQ_SIZE_ARG(2, offset);
+  REQ_SIZE_ARG(3, size);
 
   void *ptr=NULL;
-  int len=0;
+  size_t len=0;
   if(args[4]->IsUndefined() || args[4]->IsNull()) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -617,8 +1753,7 @@ NAN_METHOD(CommandQueue::enqueueReadBuffer)
   else
     getPtrAndLen(args[4],ptr,len);
 
-  // printf("offset %lu, size %lu, len %lu\n",offset,size,len);
-  if((int)offset>len) {
+  if(len<size) {
       cl_int ret=CL_INVALID_VALUE;
       REQ_ERROR_THROW(INVALID_VALUE);
       NanReturnUndefined();
@@ -626,7 +1761,7 @@ NAN_METHOD(CommandQueue::enqueueReadBuffer)
 
   MakeEventWaitList(args[5]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
 
   cl_int ret=::clEnqueueReadBuffer(
@@ -634,9 +1769,7 @@ NAN_METHOD(CommandQueue::enqueueReadBuffer)
       ptr,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->transferEventSlot(no_event, blocking_read, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -653,10 +1786,15 @@ NAN_METHOD(CommandQueue::enqueueReadBuffer)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(size, blocking_read);
+  cq->track(&event, no_event, blocking_read, size, args[4]);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -667,10 +1805,8 @@ NAN_METHOD(CommandQueue::enqueueReadBufferRect)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -701,7 +1837,7 @@ NAN_METHOD(CommandQueue::enqueueReadBufferRect)
   uint32_t host_slice_pitch=args[8]->Uint32Value();
 
   void *ptr=NULL;
-  int len=0;
+  size_t len=0;
   if(args[9]->IsUndefined() || args[9]->IsNull()) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -710,10 +1846,9 @@ NAN_METHOD(CommandQueue::enqueueReadBufferRect)
   else
     getPtrAndLen(args[9],ptr,len);
 
-  int buf_sz = bufferRectSize(buffer_origin, region, buffer_row_pitch, buffer_slice_pitch, len);
-  int host_sz = bufferRectSize(host_origin, region, host_row_pitch, host_slice_pitch, len);
-  // printf("len %d, buf off %d, host off %d\n",len,buf_sz,host_sz);
-  if (buf_sz < 0 || host_sz < 0 || buf_sz > len || host_sz > len)
+  int64_t buf_sz = bufferRectSize(buffer_origin, region, buffer_row_pitch, buffer_slice_pitch, len);
+  int64_t host_sz = bufferRectSize(host_origin, region, host_row_pitch, host_slice_pitch, len);
+  if (buf_sz < 0 || host_sz < 0 || buf_sz > (int64_t) len || host_sz > (int64_t) len)
   {
     cl_int ret = CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -722,7 +1857,7 @@ NAN_METHOD(CommandQueue::enqueueReadBufferRect)
 
   MakeEventWaitList(args[10]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[11]->IsUndefined() || args[11]->IsNull());
 
   cl_int ret=::clEnqueueReadBufferRect(
@@ -739,9 +1874,7 @@ NAN_METHOD(CommandQueue::enqueueReadBufferRect)
       ptr,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->transferEventSlot(no_event, blocking_read, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -758,10 +1891,15 @@ NAN_METHOD(CommandQueue::enqueueReadBufferRect)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(region[0]*region[1]*region[2], blocking_read);
+  cq->track(&event, no_event, blocking_read, region[0]*region[1]*region[2], args[9]);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[11]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -774,18 +1912,16 @@ NAN_METHOD(CommandQueue::enqueueCopyBuffer)
   MemoryObject *mo_dst = ObjectWrap::Unwrap<MemoryObject>(args[1]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo_src->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo_src->getContext();
+  if(!ctx1 || ctx1 != ctx2 || ctx1 != mo_dst->getContext()) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
   }
 
-  size_t src_offset = args[2]->Uint32Value();
-  size_t dst_offset = args[3]->Uint32Value();
-  size_t size = args[4]->Uint32Value();
+  REQ_SIZE_ARG(2, src_offset);
+  REQ_SIZE_ARG(3, dst_offset);
+  REQ_SIZE_ARG(4, size);
 
   size_t len_s, len_d;
   clGetMemObjectInfo(mo_src->getMemory(),CL_MEM_SIZE,sizeof(size_t),&len_s,NULL);
@@ -806,14 +1942,6 @@ NAN_METHOD(CommandQueue::enqueueCopyBuffer)
 
   MakeEventWaitList(args[5]);
 
-  if(num_evts != num_events_wait_list) {
-    delete[] events_wait_list;
-    events_wait_list=NULL;
-    cl_int ret=CL_INVALID_EVENT_WAIT_LIST;
-    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
-    NanReturnUndefined();
-  }
-
   cl_event event=NULL;
   bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
 
@@ -822,9 +1950,7 @@ NAN_METHOD(CommandQueue::enqueueCopyBuffer)
       src_offset, dst_offset, size,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -840,10 +1966,14 @@ NAN_METHOD(CommandQueue::enqueueCopyBuffer)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(size);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -855,10 +1985,8 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferRect)
   MemoryObject *mo_dst = ObjectWrap::Unwrap<MemoryObject>(args[1]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo_src->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo_src->getContext();
+  if(!ctx1 || ctx1 != ctx2 || ctx1 != mo_dst->getContext()) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -919,9 +2047,7 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferRect)
       dst_slice_pitch,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -937,10 +2063,14 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferRect)
     return NanThrowError("UNKNOWN ERROR");
   }
 
- if(!no_event) {
+  cq->enqueued(region[0]*region[1]*region[2]);
+
+  if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[10]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -951,10 +2081,8 @@ NAN_METHOD(CommandQueue::enqueueWriteImage)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -984,7 +2112,7 @@ NAN_METHOD(CommandQueue::enqueueWriteImage)
   size_t slice_pitch = 0; //args[5]->Uint32Value(); // no slice_pitch in WebCL 1.0
 
   void *ptr=NULL;
-  int len=0;
+  size_t len=0;
   if(args[5]->IsUndefined() || args[5]->IsNull()) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -993,7 +2121,7 @@ NAN_METHOD(CommandQueue::enqueueWriteImage)
   else
     getPtrAndLen(args[5],ptr,len);
 
-  if(imageRectSize(origin,region,row_pitch,slice_pitch,mo->getMemory(),len)<0) {
+  if(imageRectSize(origin,region,row_pitch,slice_pitch,mo->getMemory(),(int64_t) len)<0) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
     NanReturnUndefined();
@@ -1001,7 +2129,7 @@ NAN_METHOD(CommandQueue::enqueueWriteImage)
 
   MakeEventWaitList(args[6]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[7]->IsUndefined() || args[7]->IsNull());
 
   cl_int ret=::clEnqueueWriteImage(
@@ -1013,9 +2141,7 @@ NAN_METHOD(CommandQueue::enqueueWriteImage)
       ptr,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->transferEventSlot(no_event, blocking_write, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -1033,10 +2159,15 @@ NAN_METHOD(CommandQueue::enqueueWriteImage)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(len, blocking_write);
+  cq->track(&event, no_event, blocking_write, len, args[5]);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[7]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1047,10 +2178,8 @@ NAN_METHOD(CommandQueue::enqueueReadImage)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  if(cq->getCommandQueue()) clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  if(mo->getMemory()) clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -1074,7 +2203,7 @@ NAN_METHOD(CommandQueue::enqueueReadImage)
   size_t slice_pitch = 0;
 
   void *ptr=NULL;
-  int len=0;
+  size_t len=0;
   if(args[5]->IsUndefined() || args[5]->IsNull()) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -1083,7 +2212,7 @@ NAN_METHOD(CommandQueue::enqueueReadImage)
   else
     getPtrAndLen(args[5],ptr,len);
 
-  if(imageRectSize(origin,region,row_pitch,slice_pitch,mo->getMemory(),len)<0) {
+  if(imageRectSize(origin,region,row_pitch,slice_pitch,mo->getMemory(),(int64_t) len)<0) {
     cl_int ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
     NanReturnUndefined();
@@ -1091,7 +2220,7 @@ NAN_METHOD(CommandQueue::enqueueReadImage)
 
   MakeEventWaitList(args[6]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[7]->IsUndefined() || args[7]->IsNull());
   // printf("num_events_wait_list %d, events_wait_list %p, no_event %d\n",num_events_wait_list,events_wait_list, no_event);
 
@@ -1103,9 +2232,7 @@ NAN_METHOD(CommandQueue::enqueueReadImage)
       ptr,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->transferEventSlot(no_event, blocking_read, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -1123,10 +2250,15 @@ NAN_METHOD(CommandQueue::enqueueReadImage)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(len, blocking_read);
+  cq->track(&event, no_event, blocking_read, len, args[5]);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[7]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1138,10 +2270,8 @@ NAN_METHOD(CommandQueue::enqueueCopyImage)
   MemoryObject *mo_dst = ObjectWrap::Unwrap<MemoryObject>(args[1]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo_src->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo_src->getContext();
+  if(!ctx1 || ctx1 != ctx2 || ctx1 != mo_dst->getContext()) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -1190,7 +2320,7 @@ NAN_METHOD(CommandQueue::enqueueCopyImage)
 
   MakeEventWaitList(args[5]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
 
   cl_int ret=::clEnqueueCopyImage(
@@ -1200,9 +2330,7 @@ NAN_METHOD(CommandQueue::enqueueCopyImage)
       region,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -1221,10 +2349,14 @@ NAN_METHOD(CommandQueue::enqueueCopyImage)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1236,10 +2368,8 @@ NAN_METHOD(CommandQueue::enqueueCopyImageToBuffer)
   MemoryObject *mo_dst = ObjectWrap::Unwrap<MemoryObject>(args[1]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo_src->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo_src->getContext();
+  if(!ctx1 || ctx1 != ctx2 || ctx1 != mo_dst->getContext()) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -1274,7 +2404,7 @@ NAN_METHOD(CommandQueue::enqueueCopyImageToBuffer)
 
   MakeEventWaitList(args[5]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
 
   cl_int ret=::clEnqueueCopyImageToBuffer(
@@ -1284,9 +2414,7 @@ NAN_METHOD(CommandQueue::enqueueCopyImageToBuffer)
       dst_offset,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -1304,10 +2432,14 @@ NAN_METHOD(CommandQueue::enqueueCopyImageToBuffer)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1319,10 +2451,8 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferToImage)
   MemoryObject *mo_dst = ObjectWrap::Unwrap<MemoryObject>(args[1]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo_src->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo_src->getContext();
+  if(!ctx1 || ctx1 != ctx2 || ctx1 != mo_dst->getContext()) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -1359,7 +2489,7 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferToImage)
 
   MakeEventWaitList(args[5]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[6]->IsUndefined() || args[6]->IsNull());
 
   cl_int ret=::clEnqueueCopyBufferToImage(
@@ -1369,9 +2499,7 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferToImage)
       region,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
-
-  if(events_wait_list) delete[] events_wait_list;
+      cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
@@ -1389,17 +2517,17 @@ NAN_METHOD(CommandQueue::enqueueCopyBufferToImage)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
-void free_callback(char *data, void *hint) {
-  //cout<<"enqueueMapBuffer free_callback called"<<endl;
-}
-
 NAN_METHOD(CommandQueue::enqueueMapBuffer)
 {
   NanScope();
@@ -1409,10 +2537,8 @@ NAN_METHOD(CommandQueue::enqueueMapBuffer)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -1420,8 +2546,16 @@ NAN_METHOD(CommandQueue::enqueueMapBuffer)
 
   cl_bool blocking = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
   cl_map_flags flags = args[2]->Uint32Value();
-  size_t offset = args[3]->Uint32Value();
-  size_t size = args[4]->Uint32Value();
+  REQ_SIZE_ARG(3, offset);
+  REQ_SIZE_ARG(4, size);
+
+  // the mapped region is handed back as a node Buffer, which cannot be larger
+  // than kMaxLength. Map larger buffers in several windows.
+  if(size > node::Buffer::kMaxLength) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
 
   MakeEventWaitList(args[5]);
 
@@ -1436,8 +2570,6 @@ NAN_METHOD(CommandQueue::enqueueMapBuffer)
               events_wait_list,
               no_event ? NULL : &event, &ret);
 
-  if(events_wait_list) delete[] events_wait_list;
-
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
     REQ_ERROR_THROW(INVALID_CONTEXT);
@@ -1454,6 +2586,8 @@ NAN_METHOD(CommandQueue::enqueueMapBuffer)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(size, blocking);
+
   // cl_mem mem=mo->getMemory();
   // void *host_ptr=NULL;
   // ::clGetMemObjectInfo(mem,CL_MEM_HOST_PTR,sizeof(void*),host_ptr,NULL);
@@ -1466,18 +2600,12 @@ NAN_METHOD(CommandQueue::enqueueMapBuffer)
   // }
   // printf("\n");
 
-  // wrap OpenCL result buffer into a node Buffer
-  // WARNING: make sure result is shared not copied, otherwise unmapBuffer won't work
-  // node::Buffer *buf=node::Buffer::New((char*) result,size, free_callback, NULL);
-  Local<Object> buf=NanNewBufferHandle((char*) result, size, free_callback, NULL);
-  // printf("[map] result %p, wrapped data %p\n", result, node::Buffer::Data(buf));
-  if(node::Buffer::Data(buf) != result) {
-    printf("WARNING: data buffer has been copied\n");
-  }
+  // wrap OpenCL result buffer into a node Buffer, tracked until it is unmapped
+  Local<Object> buf=mo->addMapping(cq->getCommandQueue(), result, size);
 
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
 
   NanReturnValue(buf);
@@ -1492,10 +2620,8 @@ NAN_METHOD(CommandQueue::enqueueMapImage)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
@@ -1504,19 +2630,18 @@ NAN_METHOD(CommandQueue::enqueueMapImage)
   cl_bool blocking = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
   cl_map_flags flags = args[2]->Uint32Value();
 
-  size_t origin[3];
-  size_t region[3];
+  // 2D images may omit the third coordinate
+  size_t origin[3]={0,0,0};
+  size_t region[3]={1,1,1};
 
   Local<Array> originArray = Local<Array>::Cast(args[3]);
-  for (int i=0; i<3; i++) {
-    size_t s = originArray->Get(i)->Uint32Value();
-    origin[i] = s;
+  for (uint32_t i=0; i<3 && i<originArray->Length(); i++) {
+    origin[i] = originArray->Get(i)->Uint32Value();
   }
 
   Local<Array> regionArray = Local<Array>::Cast(args[4]);
-  for (int i=0; i<3; i++) {
-    size_t s = regionArray->Get(i)->Uint32Value();
-    region[i] = s;
+  for (uint32_t i=0; i<3 && i<regionArray->Length(); i++) {
+    region[i] = regionArray->Get(i)->Uint32Value();
   }
 
   MakeEventWaitList(args[5]);
@@ -1538,8 +2663,6 @@ NAN_METHOD(CommandQueue::enqueueMapImage)
               events_wait_list,
               no_event ? NULL : &event, &ret);
 
-  if(events_wait_list) delete[] events_wait_list;
-
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
     REQ_ERROR_THROW(INVALID_CONTEXT);
@@ -1557,15 +2680,37 @@ NAN_METHOD(CommandQueue::enqueueMapImage)
     return NanThrowError("UNKNOWN ERROR");
   }
 
-  // TODO: return image_row_pitch, image_slice_pitch?
+  // the view spans from the first to the last mapped element, rows and
+  // slices are row_pitch and slice_pitch bytes apart
+  size_t element_size=0;
+  ::clGetImageInfo(mo->getMemory(), CL_IMAGE_ELEMENT_SIZE, sizeof(size_t), &element_size, NULL);
+  size_t nbytes = region[0] * element_size + (region[1]-1) * row_pitch;
+  if(region[2]>1)
+    nbytes += (region[2]-1) * slice_pitch;
+
+  // checked before the caller's event is set: it must not end up holding
+  // the event of a map that was undone
+  if(nbytes > node::Buffer::kMaxLength) {
+    ::clEnqueueUnmapMemObject(cq->getCommandQueue(), mo->getMemory(), result, 0, NULL, NULL);
+    if(!no_event)
+      ::clReleaseEvent(event);
+    ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
 
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[6]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
 
-  size_t nbytes = region[0] * region[1] * region[2];
-  NanReturnValue(NanNewBufferHandle((char*)result, nbytes, free_callback, NULL));
+  cq->enqueued(nbytes, blocking);
+
+  Local<Object> buf=mo->addMapping(cq->getCommandQueue(), result, nbytes);
+  buf->Set(JS_STR("rowPitch"), JS_NUM((double) row_pitch));
+  buf->Set(JS_STR("slicePitch"), JS_NUM((double) slice_pitch));
+  buf->Set(JS_STR("elementSize"), JS_NUM((double) element_size));
+  NanReturnValue(buf);
 }
 
 NAN_METHOD(CommandQueue::enqueueUnmapMemObject)
@@ -1577,86 +2722,196 @@ NAN_METHOD(CommandQueue::enqueueUnmapMemObject)
   MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0, ctx2=(cl_context) -1;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
-  clGetMemObjectInfo(mo->getMemory(),CL_MEM_CONTEXT,sizeof(cl_context),&ctx2, NULL);
-  if(ctx1 != ctx2) {
+  cl_context ctx1=cq->getContext(), ctx2=mo->getContext();
+  if(!ctx1 || ctx1 != ctx2) {
     cl_int ret=CL_INVALID_CONTEXT;
     REQ_ERROR_THROW(INVALID_CONTEXT);
     NanReturnUndefined();
   }
 
-  Local<Object> buf(args[1]->ToObject());
+  // only views returned by mapping mo on this queue may be unmapped, and
+  // only once
+  MappedRegion *region=NULL;
+  if(args[1]->IsObject())
+    region=mo->findMapping(cq->getCommandQueue(), args[1]->ToObject());
+  if(!region) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
 
   MakeEventWaitList(args[2]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[3]->IsUndefined() || args[3]->IsNull());
 
-  // printf("[unmap] wrapped data %p, memobject %p\n", node::Buffer::Data(buf),mo->getMemory());
-  // printf("[unmap] Before Unmap: ");
-  char *data= (char*)node::Buffer::Data(buf);
-  // for(int i=0;i<20;i++) {
-  //   printf("%d ", data[i]);
-  // }
-  // printf("\n");
-
   cl_int ret=::clEnqueueUnmapMemObject(
       cq->getCommandQueue(), mo->getMemory(),
-      data,
+      region->ptr,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
+      cq->eventSlot(no_event, &event));
 
-  // printf("[unmap] After Unmap: ");
-  // for(int i=0;i<20;i++) {
-  //   printf("%d ",data[i]);
-  // }
-  // printf("\n");
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    return NanThrowError("UNKNOWN ERROR");
+  }
 
-  if(events_wait_list) delete[] events_wait_list;
+  cq->enqueued(0);
+
+  // stale views must not write to the region once the driver reclaims it
+  mo->removeMapping(region);
+
+  if(!no_event) {
+    Event *e=ObjectWrap::Unwrap<Event>(args[3]->ToObject());
+    e->setEvent(event, ctx1);
+  }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::enqueueMigrateMemObjects)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  cl_context ctx1=cq->getContext();
+
+  Local<Array> memArray = Local<Array>::Cast(args[0]);
+  uint32_t num_mem_objects=memArray->Length();
+  std::vector<cl_mem> mem_objects;
+  for(uint32_t i=0; i<num_mem_objects; i++) {
+    MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(memArray->Get(i)->ToObject());
+    // check for same context (seems to be buggy in Mac driver)
+    if(!ctx1 || ctx1 != mo->getContext()) {
+      cl_int ret=CL_INVALID_CONTEXT;
+      REQ_ERROR_THROW(INVALID_CONTEXT);
+      NanReturnUndefined();
+    }
+    mem_objects.push_back(mo->getMemory());
+  }
+
+  // CL_MIGRATE_MEM_OBJECT_HOST | CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED
+  cl_bitfield flags = args[1]->Uint32Value();
+  if(num_mem_objects==0 || (flags & ~((cl_bitfield) 3))) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnUndefined();
+  }
+
+  MakeEventWaitList(args[2]);
+
+  cl_event event=NULL;
+  bool no_event = (args[3]->IsUndefined() || args[3]->IsNull());
+
+  cl_int ret=CL_SUCCESS;
+#ifdef CL_VERSION_1_2
+  if(cq->device_version>=120) {
+    ret=::clEnqueueMigrateMemObjects(
+        cq->getCommandQueue(),
+        num_mem_objects, &mem_objects.front(), flags,
+        num_events_wait_list,
+        events_wait_list,
+        cq->eventSlot(no_event, &event));
+  }
+  else
+#endif
+  {
+    // OpenCL 1.1 has no way to move memory ahead of use, the command only
+    // keeps its ordering: it waits for its wait list and completes
+    ret=cq->enqueueJoin(false, num_events_wait_list, events_wait_list,
+                        cq->eventSlot(no_event, &event));
+  }
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
     REQ_ERROR_THROW(INVALID_CONTEXT);
     REQ_ERROR_THROW(INVALID_MEM_OBJECT);
     REQ_ERROR_THROW(INVALID_VALUE);
-    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_EVENT);
     REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
     REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[3]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
+cl_int CommandQueue::enqueueJoin(bool barrier, cl_uint num_events, const cl_event *events, cl_event *event)
+{
+#ifdef CL_VERSION_1_2
+  if(device_version>=120) {
+    if(barrier)
+      return ::clEnqueueBarrierWithWaitList(command_queue, num_events, events, event);
+    return ::clEnqueueMarkerWithWaitList(command_queue, num_events, events, event);
+  }
+#endif
+
+  // OpenCL 1.1: wait for the list, then a barrier if asked for, then a
+  // marker for the event. Waiting on a list also holds back later commands,
+  // which a 1.2 marker would not do.
+  cl_int ret=CL_SUCCESS;
+  if(num_events)
+    ret=::clEnqueueWaitForEvents(command_queue, num_events, events);
+  if(ret==CL_SUCCESS && barrier)
+    ret=::clEnqueueBarrier(command_queue);
+  if(ret==CL_SUCCESS && event)
+    ret=::clEnqueueMarker(command_queue, event);
+  return ret;
+}
+
 NAN_METHOD(CommandQueue::enqueueMarker)
 {
   NanScope();
   CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
 
-  cl_event event;
-  bool no_event = (args[0]->IsUndefined() || args[0]->IsNull());
+  // check for same context (seems to be buggy in Mac driver)
+  cl_context ctx1=cq->getContext();
+
+  MakeEventWaitList(args[0]);
+
+  cl_event event=NULL;
+  bool no_event = (args[1]->IsUndefined() || args[1]->IsNull());
 
-  cl_int ret = ::clEnqueueMarker(cq->getCommandQueue(), no_event ? NULL : &event);
+  cl_int ret = cq->enqueueJoin(false, num_events_wait_list, events_wait_list,
+                               cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
     REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_EVENT);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
     REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
-    Event *e=ObjectWrap::Unwrap<Event>(args[0]->ToObject());
-    e->setEvent(event);
+    Event *e=ObjectWrap::Unwrap<Event>(args[1]->ToObject());
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1666,8 +2921,7 @@ NAN_METHOD(CommandQueue::enqueueWaitForEvents)
   CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
+  cl_context ctx1=cq->getContext();
 
   MakeEventWaitList(args[0]);
 
@@ -1676,8 +2930,6 @@ NAN_METHOD(CommandQueue::enqueueWaitForEvents)
       num_events_wait_list,
       events_wait_list);
 
-  if(events_wait_list) delete[] events_wait_list;
-
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
     REQ_ERROR_THROW(INVALID_CONTEXT);
@@ -1689,6 +2941,8 @@ NAN_METHOD(CommandQueue::enqueueWaitForEvents)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   NanReturnUndefined();
 }
 
@@ -1698,60 +2952,53 @@ NAN_METHOD(CommandQueue::enqueueBarrier)
   CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
+  cl_context ctx1=cq->getContext();
 
   MakeEventWaitList(args[0]);
 
   cl_event event=NULL;
   bool no_event = (args[1]->IsUndefined() || args[1]->IsNull());
 
-  cl_int ret = ::clEnqueueBarrier(cq->getCommandQueue());
-
-  if(events_wait_list && ret==CL_SUCCESS) {
-    cl_int ret2 = ::clEnqueueWaitForEvents(
-        cq->getCommandQueue(),
-        num_events_wait_list,
-        events_wait_list);
-
-    if (ret2 != CL_SUCCESS) {
-      REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
-      REQ_ERROR_THROW(INVALID_CONTEXT);
-      REQ_ERROR_THROW(INVALID_VALUE);
-      REQ_ERROR_THROW(INVALID_EVENT);
-      REQ_ERROR_THROW(OUT_OF_RESOURCES);
-      REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
-      return NanThrowError("UNKNOWN ERROR");
-    }
-
-    delete[] events_wait_list;
-  }
+  cl_int ret = cq->enqueueJoin(true, num_events_wait_list, events_wait_list,
+                               cq->eventSlot(no_event, &event));
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(INVALID_EVENT);
+    REQ_ERROR_THROW(INVALID_EVENT_WAIT_LIST);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
     REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
     return NanThrowError("UNKNOWN ERROR");
   }
 
-  if(!no_event && event) {
+  cq->enqueued(0);
+
+  if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[1]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
 class FinishWorker : public NanAsyncWorker {
  public:
-  FinishWorker(Baton *baton)
-    : NanAsyncWorker(baton->callback), baton_(baton) {
+  FinishWorker(Baton *baton, cl_command_queue queue, uint64_t inflight_seq)
+    : NanAsyncWorker(baton->callback), baton_(baton), queue_(queue),
+      inflight_seq_(inflight_seq) {
+      // keep the queue alive while clFinish() runs on the worker thread
+      ::clRetainCommandQueue(queue_);
     }
 
   ~FinishWorker() {
+    if(queue_) ::clReleaseCommandQueue(queue_);
     if(baton_) {
       NanScope();
       // if (baton_->callback) delete baton_->callback;
-      // if (!baton_->parent.IsEmpty()) NanDisposePersistent(baton_->parent);
+      if (!baton_->parent.IsEmpty()) NanDisposePersistent(baton_->parent);
       // if (!baton_->data.IsEmpty()) NanDisposePersistent(baton_->data);
       delete baton_;
     }
@@ -1762,6 +3009,7 @@ class FinishWorker : public NanAsyncWorker {
   // here, so everything we need for input and output
   // should go on `this`.
   void Execute () {
+    baton_->error = ::clFinish(queue_);
   }
 
   // Executed when the async work is complete
@@ -1770,18 +3018,27 @@ class FinishWorker : public NanAsyncWorker {
   void HandleOKCallback () {
     NanScope();
 
-     // // must return passed data
+    // transfers enqueued before finish() are done
+    if(baton_->error==CL_SUCCESS) {
+      Local<Object> q=NanNew(baton_->parent);
+      CommandQueue *cq=ObjectWrap::Unwrap<CommandQueue>(q);
+      if(cq->retireThrough(inflight_seq_))
+        NanMakeCallback(q, "_ondrain", 0, NULL);
+    }
+
+    // return the real clFinish() status
     Local<Value> argv[] = {
-      // NanPersistentToLocal(baton_->parent),  // event
       JS_INT(baton_->error)
     };
 
-    // printf("[async event] callback JS\n");
+    // printf("[async finish] callback JS\n");
     callback->Call(1, argv);
   }
 
   private:
     Baton *baton_;
+    cl_command_queue queue_;
+    uint64_t inflight_seq_;
 };
 
 
@@ -1794,18 +3051,73 @@ NAN_METHOD(CommandQueue::finish)
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
   }
 
+  if(args.Length()>0 && args[0]->IsFunction()) {
+    // drain the queue on a worker thread so the event loop keeps running
+    Baton *baton=new Baton();
+    baton->callback=new NanCallback(args[0].As<Function>());
+    NanAssignPersistent(baton->parent, args.This());
+    NanAsyncQueueWorker(new FinishWorker(baton, cq->getCommandQueue(), cq->inflight_seq));
+    cq->resetPending();
+    NanReturnUndefined();
+  }
+
   cl_int ret = ::clFinish(cq->getCommandQueue());
+  if (ret != CL_SUCCESS) {
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(OUT_OF_RESOURCES);
+    REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
+    return NanThrowError("UNKNOWN ERROR");
+  }
+  cq->resetPending();
+  // every tracked transfer is done, don't wait for their callbacks
+  if(cq->retireThrough(cq->inflight_seq))
+    NanMakeCallback(args.This(), "_ondrain", 0, NULL);
 
-  if(args.Length()>0 && args[0]->IsFunction()) {
-      Baton *baton=new Baton();
-      baton->error=ret;
-      baton->callback=new NanCallback(args[0].As<Function>());
-      NanAsyncQueueWorker(new FinishWorker(baton));
-      NanReturnUndefined();
+  NanReturnUndefined();
+}
+
+NAN_METHOD(CommandQueue::submit)
+{
+  NanScope();
+  CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+  if(!cq->getCommandQueue()) {
+    cl_int ret=CL_INVALID_COMMAND_QUEUE;
+    REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+  }
+
+  // args: Uint32Array words, number of words, objects[], hosts[]
+  void *ptr=NULL;
+  size_t len=0;
+  getPtrAndLen(args[0], ptr, len);
+  size_t num_words=args[1]->Uint32Value();
+  if(!args[2]->IsArray() || !args[3]->IsArray() ||
+     (!ptr && num_words) || num_words*sizeof(uint32_t)>len) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
   }
 
-  else if (ret != CL_SUCCESS) {
+  CommandStream stream;
+  cl_int ret=stream.bind((const uint32_t*) ptr, num_words,
+                         Local<Array>::Cast(args[2]), Local<Array>::Cast(args[3]));
+  if(ret==CL_SUCCESS)
+    ret=stream.execute(cq, Local<Array>::Cast(args[3]), NULL);
+
+  if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_COMMAND_QUEUE);
+    REQ_ERROR_THROW(INVALID_CONTEXT);
+    REQ_ERROR_THROW(INVALID_MEM_OBJECT);
+    REQ_ERROR_THROW(INVALID_PROGRAM_EXECUTABLE);
+    REQ_ERROR_THROW(INVALID_KERNEL);
+    REQ_ERROR_THROW(INVALID_KERNEL_ARGS);
+    REQ_ERROR_THROW(INVALID_WORK_DIMENSION);
+    REQ_ERROR_THROW(INVALID_GLOBAL_WORK_SIZE);
+    REQ_ERROR_THROW(INVALID_WORK_GROUP_SIZE);
+    REQ_ERROR_THROW(INVALID_WORK_ITEM_SIZE);
+    REQ_ERROR_THROW(INVALID_GLOBAL_OFFSET);
+    REQ_ERROR_THROW(INVALID_VALUE);
+    REQ_ERROR_THROW(MISALIGNED_SUB_BUFFER_OFFSET);
+    REQ_ERROR_THROW(MEM_COPY_OVERLAP);
+    REQ_ERROR_THROW(MEM_OBJECT_ALLOCATION_FAILURE);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
     REQ_ERROR_THROW(OUT_OF_HOST_MEMORY);
     return NanThrowError("UNKNOWN ERROR");
@@ -1827,6 +3139,8 @@ NAN_METHOD(CommandQueue::flush)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->num_flushes++;
+  cq->resetPending();
   NanReturnUndefined();
 }
 
@@ -1836,8 +3150,7 @@ NAN_METHOD(CommandQueue::enqueueAcquireGLObjects)
   CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
+  cl_context ctx1=cq->getContext();
 
   cl_mem *mem_objects=NULL;
   int num_objects=0;
@@ -1858,17 +3171,16 @@ NAN_METHOD(CommandQueue::enqueueAcquireGLObjects)
 
   MakeEventWaitList(args[1]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[2]->IsUndefined() || args[2]->IsNull());
 
   int ret = ::clEnqueueAcquireGLObjects(cq->getCommandQueue(),
       num_objects, mem_objects,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
+      cq->eventSlot(no_event, &event));
 
   if(mem_objects) delete[] mem_objects;
-  if(events_wait_list) delete[] events_wait_list;
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -1882,10 +3194,14 @@ NAN_METHOD(CommandQueue::enqueueAcquireGLObjects)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[2]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1895,8 +3211,7 @@ NAN_METHOD(CommandQueue::enqueueReleaseGLObjects)
   CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
 
   // check for same context (seems to be buggy in Mac driver)
-  cl_context ctx1=0;
-  clGetCommandQueueInfo(cq->getCommandQueue(),CL_QUEUE_CONTEXT,sizeof(cl_context),&ctx1, NULL);
+  cl_context ctx1=cq->getContext();
 
   cl_mem *mem_objects=NULL;
   int num_objects=0;
@@ -1917,17 +3232,16 @@ NAN_METHOD(CommandQueue::enqueueReleaseGLObjects)
 
   MakeEventWaitList(args[1]);
 
-  cl_event event;
+  cl_event event=NULL;
   bool no_event = (args[2]->IsUndefined() || args[2]->IsNull());
 
   int ret = ::clEnqueueReleaseGLObjects(cq->getCommandQueue(),
       num_objects, mem_objects,
       num_events_wait_list,
       events_wait_list,
-      no_event ? NULL : &event);
+      cq->eventSlot(no_event, &event));
 
   if(mem_objects) delete[] mem_objects;
-  if(events_wait_list) delete[] events_wait_list;
 
   if (ret != CL_SUCCESS) {
     REQ_ERROR_THROW(INVALID_VALUE);
@@ -1941,10 +3255,14 @@ NAN_METHOD(CommandQueue::enqueueReleaseGLObjects)
     return NanThrowError("UNKNOWN ERROR");
   }
 
+  cq->enqueued(0);
+
   if(!no_event) {
     Event *e=ObjectWrap::Unwrap<Event>(args[2]->ToObject());
-    e->setEvent(event);
+    e->setEvent(event, ctx1);
   }
+  else if(event)
+    NanReturnValue(JS_NUM((double) cq->addTicket(event)));
   NanReturnUndefined();
 }
 
@@ -1966,6 +3284,18 @@ CommandQueue *CommandQueue::New(cl_command_queue cw, WebCLObject *parent)
 
   CommandQueue *commandqueue = ObjectWrap::Unwrap<CommandQueue>(obj);
   commandqueue->command_queue = cw;
+  // cache the owning context, enqueue calls compare it with their arguments'
+  ::clGetCommandQueueInfo(cw, CL_QUEUE_CONTEXT, sizeof(cl_context), &commandqueue->context, NULL);
+
+  // and the device version, 1.2 commands are emulated on older devices
+  cl_device_id device;
+  char version[128]={0};
+  int major=1, minor=0;
+  if(::clGetCommandQueueInfo(cw, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL)==CL_SUCCESS &&
+     ::clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(version)-1, version, NULL)==CL_SUCCESS)
+    sscanf(version, "OpenCL %d.%d", &major, &minor);
+  commandqueue->device_version=major*100+minor*10;
+
   registerCLObj(cw, commandqueue);
 
   return commandqueue;
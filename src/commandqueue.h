@@ -28,6 +28,9 @@
 #define COMMANDQUEUE_H_
 
 #include "common.h"
+#include <uv.h>
+#include <deque>
+#include <map>
 
 namespace webcl {
 
@@ -59,6 +62,17 @@ public:
   static NAN_METHOD(enqueueWriteBufferRect);
   static NAN_METHOD(enqueueWriteImage);
 
+  // Scatter/gather: many Host <-> Buffer ranges in one call
+  static NAN_METHOD(enqueueWriteBufferScatter);
+  static NAN_METHOD(enqueueReadBufferGather);
+
+  // Filling: Pattern -> Buffer, Color -> Image
+  static NAN_METHOD(enqueueFillBuffer);
+  static NAN_METHOD(enqueueFillImage);
+
+  // Moving memory objects between devices of the context, or to the host
+  static NAN_METHOD(enqueueMigrateMemObjects);
+
   // Executing kernels
   static NAN_METHOD(enqueueNDRangeKernel);
   static NAN_METHOD(enqueueTask);
@@ -70,6 +84,22 @@ public:
   static NAN_METHOD(flush);
   static NAN_METHOD(finish);
 
+  // Batch submission of a binary command stream
+  static NAN_METHOD(submit);
+
+  // Auto-flush policy
+  static NAN_METHOD(setFlushPolicy);
+  static NAN_METHOD(getFlushStats);
+
+  // Ticket completion mode
+  static NAN_METHOD(setTicketMode);
+  static NAN_METHOD(completedUpTo);
+  static NAN_METHOD(waitTicket);
+
+  // In-flight accounting of host transfers
+  static NAN_METHOD(setHighWaterMark);
+  static NAN_METHOD(getInFlight);
+
   // Querying command queue information
   static NAN_METHOD(getInfo);
   static NAN_METHOD(release);
@@ -84,8 +114,55 @@ public:
   static NAN_METHOD(enqueueReleaseGLObjects);
 
   cl_command_queue getCommandQueue() const { return command_queue; };
+  cl_context getContext() const { return context; };
   virtual bool operator==(void *clObj) { return ((cl_command_queue)clObj)==command_queue; }
 
+  // accounts for a command just enqueued with bytes of transfer and flushes
+  // the queue if the policy says so. A blocking command flushed it already.
+  void enqueued(size_t bytes, bool blocking=false);
+  // flushes the commands enqueued since the last flush, if any
+  void flushPending();
+  // called before JS waits on event, flushes its queue if that queue's
+  // policy asks for it
+  static void flushForWait(cl_event event);
+
+  // where an enqueue call should store its event: the caller's if it asked
+  // for one, a ticket's in ticket mode, else nowhere
+  cl_event *eventSlot(bool no_event, cl_event *event) const {
+    return (!no_event || ticket_mode) ? event : NULL;
+  }
+  // where a host transfer should store its event: each non-blocking
+  // transfer needs one to know when its host memory is free again
+  cl_event *transferEventSlot(bool no_event, bool blocking, cl_event *event) const {
+    return (!no_event || ticket_mode || !blocking) ? event : NULL;
+  }
+  // counts a non-blocking transfer and keeps host alive until it completes.
+  // Releases *event and sets it to NULL when neither a WebCLEvent nor a
+  // ticket takes it.
+  void track(cl_event *event, bool no_event, bool blocking, size_t bytes, v8::Handle<v8::Value> host);
+  // main thread, tracked transfer seq completed. Returns true when this
+  // takes the queue back below its high-water mark.
+  bool retired(uint64_t seq);
+  // main thread, a finish covering transfers up to seq returned: they are
+  // complete even if their callbacks haven't been delivered yet. Returns
+  // true when this takes the queue back below its high-water mark.
+  bool retireThrough(uint64_t seq);
+
+  // takes ownership of event and returns its ticket number
+  uint64_t addTicket(cl_event event);
+
+  // enqueues a marker, or a barrier, that completes once the events in the
+  // wait list (or every previous command if it is empty) have completed.
+  // Uses the OpenCL 1.2 commands when the device has them. event may be NULL.
+  cl_int enqueueJoin(bool barrier, cl_uint num_events, const cl_event *events, cl_event *event);
+
+  // device buffer of at least size bytes staging packed scatter/gather
+  // ranges, reused across calls and grown on demand. A command using it must
+  // wait for *done, the last command that used it, and then pass its own
+  // event to stagingUsed().
+  cl_mem getStaging(size_t size, cl_event *done, cl_int *ret);
+  void stagingUsed(cl_event event);
+
 private:
   CommandQueue(v8::Handle<v8::Object> wrapper);
   ~CommandQueue();
@@ -93,6 +170,56 @@ private:
   static v8::Persistent<v8::Function> constructor;
 
   cl_command_queue command_queue;
+  cl_context context;
+
+  // OpenCL version of the queue's device, e.g. 120 for 1.2
+  cl_uint device_version;
+
+  // forgets pending work after an explicit or implicit flush
+  void resetPending();
+  // (re)starts the countdown to flushing the pending commands
+  void startFlushTimer();
+
+  // auto-flush policy, 0 disables a limit
+  uint32_t flush_commands;
+  uint64_t flush_bytes;
+  uint32_t flush_millis;
+  bool flush_on_wait;
+
+  // work enqueued since the last flush
+  uint32_t pending_commands;
+  uint64_t pending_bytes;
+  uv_timer_t *flush_timer;
+
+  uint32_t num_flushes, num_auto_flushes;
+
+  // retires completed tickets from the front of the ring
+  void retireTickets();
+  void releaseTickets();
+
+  void releaseStaging();
+  cl_mem staging;
+  size_t staging_size;
+  cl_event staging_done;
+
+  // ticket mode: enqueues made without a WebCLEvent keep their cl_event in
+  // this ring and return its ticket number. tickets.front() is ticket_base.
+  bool ticket_mode;
+  std::deque<cl_event> tickets;
+  uint64_t ticket_base;
+  // first ticket whose command failed, 0 if none
+  uint64_t failed_ticket;
+
+  bool aboveHighWater() const;
+
+  // in-flight accounting of non-blocking host transfers, 0 disables a limit
+  uint64_t high_water_bytes;
+  uint32_t high_water_commands;
+  uint64_t inflight_bytes, peak_inflight_bytes;
+  uint32_t inflight_commands;
+  // bytes of each transfer still in flight, by sequence number
+  std::map<uint64_t, size_t> inflight;
+  uint64_t inflight_seq;
 
 private:
   DISABLE_COPY(CommandQueue)
@@ -0,0 +1,306 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "commandstream.h"
+#include "commandqueue.h"
+#include "memoryobject.h"
+#include "event.h"
+#include "kernel.h"
+#include "sampler.h"
+#include "cl_checks.h"
+#include <cstring>
+
+using namespace v8;
+using namespace node;
+
+namespace webcl {
+
+static const uint32_t command_sizes[CommandStreamOp::MAX_OPS] = {
+  0,   // invalid
+  15,  // NDRangeKernel
+  11,  // WriteBuffer
+  11,  // ReadBuffer
+  10,  // CopyBuffer
+  2,   // Barrier
+  2,   // Marker
+  6,   // SetArg
+};
+
+static inline size_t read64(const uint32_t *w)
+{
+  return (size_t) (((uint64_t) w[1] << 32) | w[0]);
+}
+
+uint32_t CommandStream::commandSize(uint32_t op)
+{
+  return op<CommandStreamOp::MAX_OPS ? command_sizes[op] : 0;
+}
+
+// classes a stream may reference, their wrappers hold a WebCLObject
+static const char *stream_classes[]={
+  "WebCLKernel", "WebCLBuffer", "WebCLImage", "WebCLMemoryObject",
+  "WebCLEvent", "WebCLUserEvent", "WebCLSampler", NULL
+};
+
+// unwraps a WebCL object, NULL if value is not one. Other native wrappers
+// have internal fields too, so the class is checked before unwrapping.
+static WebCLObject *unwrapObject(Local<Value> value)
+{
+  if(!value->IsObject())
+    return NULL;
+  Local<Object> obj=value->ToObject();
+  if(obj->InternalFieldCount()<1)
+    return NULL;
+  String::AsciiValue name(obj->GetConstructorName());
+  for(const char **c=stream_classes; *c; c++) {
+    if(!strcmp(*c, *name))
+      return ObjectWrap::Unwrap<WebCLObject>(obj);
+  }
+  return NULL;
+}
+
+cl_int CommandStream::bind(const uint32_t *words, size_t num_words,
+                           Local<Array> objects, Local<Array> hosts,
+                           uint32_t num_params)
+{
+  words_=words;
+  num_words_=num_words;
+  num_params_=num_params;
+
+  objects_.resize(objects->Length());
+  for(uint32_t i=0;i<objects_.size();i++)
+    objects_[i]=unwrapObject(objects->Get(i));
+
+  hosts_.resize(hosts->Length());
+  for(uint32_t i=0;i<hosts_.size();i++) {
+    void *ptr=NULL;
+    size_t len=0;
+    getPtrAndLen(hosts->Get(i), ptr, len);
+    hosts_[i].ptr=(char*) ptr;
+    hosts_[i].len=len;
+  }
+
+  #define CHECK_OBJECT(index, type) \
+    if((index)>=objects_.size() || !objects_[index] || \
+       objects_[index]->getType()!=CLObjType::type) \
+      return CL_INVALID_VALUE;
+
+  const uint32_t *w=words_, *end=words_+num_words_;
+  while(w<end) {
+    uint32_t size=commandSize(w[0]);
+    if(!size || w+size>end)
+      return CL_INVALID_VALUE;
+
+    if(w[1]!=STREAM_NO_HANDLE) {
+      if(w[0]==CommandStreamOp::Barrier || w[0]==CommandStreamOp::SetArg)
+        return CL_INVALID_VALUE;
+      CHECK_OBJECT(w[1], Event);
+    }
+
+    switch(w[0]) {
+    case CommandStreamOp::NDRangeKernel:
+      CHECK_OBJECT(w[2], Kernel);
+      if(w[3]<1 || w[3]>3)
+        return CL_INVALID_WORK_DIMENSION;
+      break;
+    case CommandStreamOp::WriteBuffer:
+    case CommandStreamOp::ReadBuffer: {
+      CHECK_OBJECT(w[2], MemoryObject);
+      size_t nbytes=read64(w+6), host_offset=read64(w+9);
+      if(w[8]>=hosts_.size() || !hosts_[w[8]].ptr ||
+         host_offset>hosts_[w[8]].len || nbytes>hosts_[w[8]].len-host_offset)
+        return CL_INVALID_VALUE;
+      break;
+    }
+    case CommandStreamOp::CopyBuffer:
+      CHECK_OBJECT(w[2], MemoryObject);
+      CHECK_OBJECT(w[3], MemoryObject);
+      break;
+    case CommandStreamOp::SetArg:
+      CHECK_OBJECT(w[2], Kernel);
+      switch(w[4]) {
+      case CommandStreamArg::Object:
+        if(w[5]>=objects_.size() || !objects_[w[5]] ||
+           (objects_[w[5]]->getType()!=CLObjType::MemoryObject &&
+            objects_[w[5]]->getType()!=CLObjType::Sampler))
+          return CL_INVALID_VALUE;
+        break;
+      case CommandStreamArg::Host:
+        if(w[5]>=hosts_.size() || !hosts_[w[5]].ptr)
+          return CL_INVALID_VALUE;
+        break;
+      case CommandStreamArg::Param:
+        if(w[5]>=num_params_)
+          return CL_INVALID_VALUE;
+        break;
+      default:
+        return CL_INVALID_VALUE;
+      }
+      break;
+    }
+
+    w+=size;
+  }
+  #undef CHECK_OBJECT
+
+  return CL_SUCCESS;
+}
+
+cl_int CommandStream::execute(CommandQueue *cq, Handle<Array> hosts, size_t *failed_at,
+                              const std::vector<HostRegion> *params) const
+{
+  cl_command_queue queue=cq->getCommandQueue();
+  cl_context ctx=cq->getContext();
+  cl_int ret=CL_SUCCESS;
+  size_t index=0;
+
+  const uint32_t *w=words_, *end=words_+num_words_;
+  for(; w<end; w+=command_sizes[w[0]], index++) {
+    cl_event event=NULL;
+    bool no_event = (w[1]==STREAM_NO_HANDLE);
+    cl_event *pevent = no_event ? NULL : &event;
+    size_t bytes=0;
+    bool blocking=false;
+
+    switch(w[0]) {
+    case CommandStreamOp::NDRangeKernel: {
+      Kernel *k=static_cast<Kernel*>(objects_[w[2]]);
+      if(k->getContext()!=ctx) {
+        ret=CL_INVALID_CONTEXT;
+        break;
+      }
+      cl_uint work_dim=w[3];
+      size_t offsets[3], globals[3], locals[3];
+      bool has_offsets=false;
+      for(cl_uint i=0;i<work_dim;i++) {
+        offsets[i]=w[4+i];
+        globals[i]=w[7+i];
+        locals[i]=w[10+i];
+        has_offsets |= (offsets[i]!=0);
+      }
+      ret=::clEnqueueNDRangeKernel(queue, k->getKernel(), work_dim,
+          has_offsets ? offsets : NULL, globals, locals[0] ? locals : NULL,
+          0, NULL, pevent);
+      break;
+    }
+    case CommandStreamOp::WriteBuffer:
+    case CommandStreamOp::ReadBuffer: {
+      MemoryObject *mo=static_cast<MemoryObject*>(objects_[w[2]]);
+      if(mo->getContext()!=ctx) {
+        ret=CL_INVALID_CONTEXT;
+        break;
+      }
+      blocking = (w[3]!=0);
+      pevent=cq->transferEventSlot(no_event, blocking, &event);
+      size_t offset=read64(w+4), size=read64(w+6);
+      char *ptr=hosts_[w[8]].ptr + read64(w+9);
+      if(w[0]==CommandStreamOp::WriteBuffer)
+        ret=::clEnqueueWriteBuffer(queue, mo->getMemory(), blocking ? CL_TRUE : CL_FALSE,
+            offset, size, ptr, 0, NULL, pevent);
+      else
+        ret=::clEnqueueReadBuffer(queue, mo->getMemory(), blocking ? CL_TRUE : CL_FALSE,
+            offset, size, ptr, 0, NULL, pevent);
+      bytes=size;
+      break;
+    }
+    case CommandStreamOp::CopyBuffer: {
+      MemoryObject *src=static_cast<MemoryObject*>(objects_[w[2]]);
+      MemoryObject *dst=static_cast<MemoryObject*>(objects_[w[3]]);
+      if(src->getContext()!=ctx || dst->getContext()!=ctx) {
+        ret=CL_INVALID_CONTEXT;
+        break;
+      }
+      bytes=read64(w+8);
+      ret=::clEnqueueCopyBuffer(queue, src->getMemory(), dst->getMemory(),
+          read64(w+4), read64(w+6), bytes, 0, NULL, pevent);
+      break;
+    }
+    case CommandStreamOp::Barrier:
+      ret=::clEnqueueBarrier(queue);
+      break;
+    case CommandStreamOp::Marker:
+      if(!pevent) {
+        // a marker without event has no observable effect
+        cl_event marker;
+        ret=::clEnqueueMarker(queue, &marker);
+        if(ret==CL_SUCCESS) ::clReleaseEvent(marker);
+      }
+      else
+        ret=::clEnqueueMarker(queue, pevent);
+      break;
+    case CommandStreamOp::SetArg: {
+      // kernel state only, nothing is enqueued
+      Kernel *k=static_cast<Kernel*>(objects_[w[2]]);
+      WebCLObject *obj=(w[4]==CommandStreamArg::Object) ? objects_[w[5]] : NULL;
+      if(obj && obj->getType()==CLObjType::Sampler) {
+        cl_sampler sampler=static_cast<Sampler*>(obj)->getSampler();
+        ret=::clSetKernelArg(k->getKernel(), w[3], sizeof(cl_sampler), &sampler);
+      }
+      else if(obj) {
+        cl_mem mem=static_cast<MemoryObject*>(obj)->getMemory();
+        ret=::clSetKernelArg(k->getKernel(), w[3], sizeof(cl_mem), &mem);
+      }
+      else {
+        const HostRegion *value=NULL;
+        if(w[4]==CommandStreamArg::Host)
+          value=&hosts_[w[5]];
+        else if(params && w[5]<params->size())
+          value=&(*params)[w[5]];
+        if(!value || !value->ptr)
+          ret=CL_INVALID_KERNEL_ARGS;
+        else
+          ret=::clSetKernelArg(k->getKernel(), w[3], value->len, value->ptr);
+      }
+      if(ret!=CL_SUCCESS) {
+        if(failed_at) *failed_at=index;
+        return ret;
+      }
+      continue;
+    }
+    }
+
+    if(ret!=CL_SUCCESS) {
+      if(failed_at) *failed_at=index;
+      return ret;
+    }
+
+    if(w[0]==CommandStreamOp::WriteBuffer || w[0]==CommandStreamOp::ReadBuffer) {
+      cq->track(&event, no_event, blocking, bytes, hosts->Get(w[8]));
+      // streams don't return tickets
+      if(no_event && event) {
+        ::clReleaseEvent(event);
+        event=NULL;
+      }
+    }
+    if(!no_event)
+      static_cast<Event*>(objects_[w[1]])->setEvent(event, ctx);
+    cq->enqueued(bytes, blocking);
+  }
+
+  return CL_SUCCESS;
+}
+
+} // namespace webcl
@@ -0,0 +1,121 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef COMMANDSTREAM_H_
+#define COMMANDSTREAM_H_
+
+#include "common.h"
+#include <vector>
+
+namespace webcl {
+
+class CommandQueue;
+
+// Binary encoding of a batch of commands, submitted with one native call.
+// A stream is an array of 32-bit words. Each command starts with its opcode
+// and the index of the WebCLEvent that receives its event (STREAM_NO_HANDLE
+// for none). Objects (kernels, memory objects, events) and host memory
+// (ArrayBufferView) are referenced by index in two side tables. 64-bit
+// offsets and sizes take two words, low word first.
+//
+//  NDRANGE_KERNEL  op, event, kernel, workDim, offset[3], global[3], local[3]
+//                  (local[0]==0 means no local size)
+//  WRITE_BUFFER    op, event, buffer, blocking, offset(2), size(2), host, hostOffset(2)
+//  READ_BUFFER     op, event, buffer, blocking, offset(2), size(2), host, hostOffset(2)
+//  COPY_BUFFER     op, event, src, dst, srcOffset(2), dstOffset(2), size(2)
+//  BARRIER         op, STREAM_NO_HANDLE
+//  MARKER          op, event
+//  SET_ARG         op, STREAM_NO_HANDLE, kernel, argIndex, source, value
+//                  source STREAM_ARG_OBJECT: value is a memory object or sampler
+//                  source STREAM_ARG_HOST:   value is a host region, passed whole
+//                  source STREAM_ARG_PARAM:  value is a parameter slot, whose
+//                                            bytes are given at execution
+namespace CommandStreamOp {
+enum CommandStreamOp {
+  NDRangeKernel=1,
+  WriteBuffer,
+  ReadBuffer,
+  CopyBuffer,
+  Barrier,
+  Marker,
+  SetArg,
+  MAX_OPS
+};
+}
+
+namespace CommandStreamArg {
+enum CommandStreamArg {
+  Object=0,
+  Host,
+  Param
+};
+}
+
+static const uint32_t STREAM_NO_HANDLE=0xFFFFFFFF;
+
+struct HostRegion {
+  char *ptr;
+  size_t len;
+};
+
+class CommandStream
+{
+public:
+  CommandStream() : words_(NULL), num_words_(0), num_params_(0) {}
+
+  // Resolves the side tables and validates the whole stream, so a malformed
+  // stream is rejected before anything is enqueued. SET_ARG commands may use
+  // parameter slots below num_params.
+  // Returns CL_SUCCESS or a CL error code.
+  cl_int bind(const uint32_t *words, size_t num_words,
+              v8::Local<v8::Array> objects, v8::Local<v8::Array> hosts,
+              uint32_t num_params=0);
+
+  // Enqueues all commands on cq, params holds the bytes of each parameter
+  // slot. hosts is the table given to bind(), non-blocking transfers keep
+  // their host memory alive until they complete. On error, commands before
+  // *failed_at have already been enqueued.
+  cl_int execute(CommandQueue *cq, v8::Handle<v8::Array> hosts, size_t *failed_at,
+                 const std::vector<HostRegion> *params=NULL) const;
+
+  // number of words of a command, 0 for an unknown opcode
+  static uint32_t commandSize(uint32_t op);
+
+protected:
+  const uint32_t *words_;
+  size_t num_words_;
+  uint32_t num_params_;
+
+  std::vector<WebCLObject*> objects_;
+  std::vector<HostRegion> hosts_;
+
+private:
+  DISABLE_COPY(CommandStream)
+};
+
+} // namespace webcl
+
+#endif // COMMANDSTREAM_H_
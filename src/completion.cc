@@ -0,0 +1,98 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "completion.h"
+#include <atomic>
+
+namespace webcl {
+
+// pending items, pushed LIFO by driver threads
+static std::atomic<CompletionItem*> head(NULL);
+static uv_async_t async_handle;
+static bool initialized=false;
+// number of items expected but not yet delivered (main thread only)
+static int pending=0;
+
+void CompletionQueue::Init()
+{
+  if(initialized) return;
+  uv_async_init(uv_default_loop(), &async_handle, Drain);
+  // only keep the loop alive while items are pending
+  uv_unref((uv_handle_t*) &async_handle);
+  initialized=true;
+}
+
+void CompletionQueue::Ref()
+{
+  if(pending++ == 0)
+    uv_ref((uv_handle_t*) &async_handle);
+}
+
+void CompletionQueue::Unref()
+{
+  if(pending>0 && --pending == 0)
+    uv_unref((uv_handle_t*) &async_handle);
+}
+
+void CompletionQueue::Post(CompletionItem *item)
+{
+  CompletionItem *old=head.load(std::memory_order_relaxed);
+  do {
+    item->next=old;
+  } while(!head.compare_exchange_weak(old, item,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed));
+
+  // libuv coalesces multiple sends into a single Drain() call
+  uv_async_send(&async_handle);
+}
+
+NAUV_WORK_CB(CompletionQueue::Drain)
+{
+  CompletionItem *list=head.exchange(NULL, std::memory_order_acquire);
+
+  // restore posting order
+  CompletionItem *items=NULL;
+  while(list) {
+    CompletionItem *next=list->next;
+    list->next=items;
+    items=list;
+    list=next;
+  }
+
+  // printf("[CompletionQueue] draining batch\n");
+  NanScope();
+  while(items) {
+    CompletionItem *next=items->next;
+    items->Complete();
+    bool counted=items->counted;
+    delete items;
+    if(counted) Unref();
+    items=next;
+  }
+}
+
+} // namespace webcl
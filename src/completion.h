@@ -0,0 +1,74 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef COMPLETION_H_
+#define COMPLETION_H_
+
+#include "common.h"
+
+namespace webcl {
+
+// A unit of work posted by an OpenCL driver thread (e.g. from an event
+// callback) and completed later on the main thread, where V8 is usable.
+class CompletionItem {
+public:
+  CompletionItem() : next(NULL), status(CL_SUCCESS), counted(true) {}
+  virtual ~CompletionItem() {}
+
+  // called on the main thread, the item is deleted right after
+  virtual void Complete() = 0;
+
+  CompletionItem *next;
+  cl_int status;
+  // false for items whose poster holds its own Ref() for as long as it may
+  // post, e.g. one that coalesces many completions into few items
+  bool counted;
+};
+
+// Lock-free multi-producer queue drained by a single uv_async_t.
+// Driver threads Post() completed items; all items posted before the loop
+// gets to the async handle are delivered together in one loop tick.
+class CompletionQueue {
+public:
+  // main thread, once at module load
+  static void Init();
+
+  // main thread: Ref() once for each item that will be posted later, so the
+  // event loop stays alive until it has been delivered. Unref() if the item
+  // will never be posted (e.g. clSetEventCallback failed).
+  static void Ref();
+  static void Unref();
+
+  // any thread
+  static void Post(CompletionItem *item);
+
+private:
+  static NAUV_WORK_CB(Drain);
+};
+
+} // namespace webcl
+
+#endif // COMPLETION_H_
@@ -36,6 +36,7 @@
 
 #include <node_buffer.h>
 #include <vector>
+#include <cstring>
 
 using namespace node;
 using namespace v8;
@@ -74,7 +75,7 @@ void Context::Init(Handle<Object> exports)
   exports->Set(NanNew<String>("WebCLContext"), ctor->GetFunction());
 }
 
-Context::Context(Handle<Object> wrapper) : context(0)
+Context::Context(Handle<Object> wrapper) : context(0), builtins(0)
 {
   _type=CLObjType::Context;
 }
@@ -83,11 +84,15 @@ Context::~Context() {
 #ifdef LOGGING
   printf("In ~Context\n");
 #endif
+  releaseBuiltins();
 }
 
 void Context::Destructor()
 {
   if(context) {
+    // the built-in program and kernels hold references to the context, drop
+    // them first so the count below is the user's
+    releaseBuiltins();
 
     cl_uint count;
     ::clGetContextInfo(context,CL_CONTEXT_REFERENCE_COUNT,sizeof(cl_uint),&count,NULL);
@@ -102,6 +107,88 @@ void Context::Destructor()
   }
 }
 
+// Kernels used internally by the library. Each is a plain OpenCL 1.1 kernel,
+// image ones are only compiled when the devices support images.
+static const char *builtin_source =
+"typedef struct { uchar b[128]; } webcl_pattern;\n"
+"__kernel void webcl_fill_buffer(__global uchar *dst, webcl_pattern pattern, uint pattern_size)\n"
+"{\n"
+"  __global uchar *p = dst + get_global_id(0) * pattern_size;\n"
+"  for(uint k = 0; k < pattern_size; k++) p[k] = pattern.b[k];\n"
+"}\n"
+"__kernel void webcl_fill_buffer4(__global uint *dst, uint pattern)\n"
+"{\n"
+"  dst[get_global_id(0)] = pattern;\n"
+"}\n"
+"__kernel void webcl_fill_buffer16(__global uint4 *dst, uint4 pattern)\n"
+"{\n"
+"  dst[get_global_id(0)] = pattern;\n"
+"}\n"
+"__kernel void webcl_copy_ranges(__global uchar *dst, __global const uchar *src,\n"
+"                                __global const ulong *table, uint count, uint lanes)\n"
+"{\n"
+"  size_t r = get_global_id(0) / lanes, lane = get_global_id(0) % lanes;\n"
+"  if(r >= count) return;\n"
+"  ulong d = table[3*r], s = table[3*r+1], n = table[3*r+2];\n"
+"  for(ulong k = lane; k < n; k += lanes) dst[d + k] = src[s + k];\n"
+"}\n"
+"#ifdef __IMAGE_SUPPORT__\n"
+"__kernel void webcl_fill_imagef(__write_only image2d_t img, float4 color)\n"
+"{\n"
+"  write_imagef(img, (int2)(get_global_id(0), get_global_id(1)), color);\n"
+"}\n"
+"__kernel void webcl_fill_imagei(__write_only image2d_t img, int4 color)\n"
+"{\n"
+"  write_imagei(img, (int2)(get_global_id(0), get_global_id(1)), color);\n"
+"}\n"
+"__kernel void webcl_fill_imageui(__write_only image2d_t img, uint4 color)\n"
+"{\n"
+"  write_imageui(img, (int2)(get_global_id(0), get_global_id(1)), color);\n"
+"}\n"
+"#endif\n";
+
+cl_kernel Context::getBuiltinKernel(const char *name, cl_int *ret)
+{
+  std::map<std::string, cl_kernel>::iterator it=builtin_kernels.find(name);
+  if(it!=builtin_kernels.end()) {
+    *ret=CL_SUCCESS;
+    return it->second;
+  }
+
+  if(!builtins) {
+    size_t length=strlen(builtin_source);
+    builtins=::clCreateProgramWithSource(context, 1, &builtin_source, &length, ret);
+    if(*ret!=CL_SUCCESS) {
+      builtins=0;
+      return NULL;
+    }
+    *ret=::clBuildProgram(builtins, 0, NULL, NULL, NULL, NULL);
+    if(*ret!=CL_SUCCESS) {
+      ::clReleaseProgram(builtins);
+      builtins=0;
+      return NULL;
+    }
+  }
+
+  cl_kernel kernel=::clCreateKernel(builtins, name, ret);
+  if(*ret!=CL_SUCCESS)
+    return NULL;
+  builtin_kernels[name]=kernel;
+  return kernel;
+}
+
+void Context::releaseBuiltins()
+{
+  std::map<std::string, cl_kernel>::iterator it;
+  for(it=builtin_kernels.begin(); it!=builtin_kernels.end(); ++it)
+    ::clReleaseKernel(it->second);
+  builtin_kernels.clear();
+  if(builtins) {
+    ::clReleaseProgram(builtins);
+    builtins=0;
+  }
+}
+
 NAN_METHOD(Context::release)
 {
 #ifdef LOGGING
@@ -439,7 +526,7 @@ NAN_METHOD(Context::createBuffer)
   NanScope();
   Context *context = ObjectWrap::Unwrap<Context>(args.This());
   cl_mem_flags flags = args[0]->Uint32Value();
-  size_t size = args[1]->Uint32Value();
+  REQ_SIZE_ARG(1, size);
   void *host_ptr = NULL;
   if(!args[2]->IsNull() && !args[2]->IsUndefined()) {
     if(args[2]->IsArray()) {
@@ -28,6 +28,8 @@
 #define WEBCL_CONTEXT_H_
 
 #include "common.h"
+#include <map>
+#include <string>
 
 namespace webcl {
 
@@ -66,6 +68,11 @@ public:
   cl_context getContext() const { return context; };
   virtual bool operator==(void *clObj) { return ((cl_context)clObj)==context; }
 
+  // returns one of the kernels the library uses internally (e.g. to emulate
+  // OpenCL 1.2 commands on 1.1 devices). The program is built on first use
+  // and kept until the context is destroyed.
+  cl_kernel getBuiltinKernel(const char *name, cl_int *ret);
+
 private:
   Context(v8::Handle<v8::Object> wrapper);
   ~Context();
@@ -75,6 +82,11 @@ private:
   cl_context context;
   v8::Persistent<v8::Object> webgl_context_;
 
+  void releaseBuiltins();
+
+  cl_program builtins;
+  std::map<std::string, cl_kernel> builtin_kernels;
+
 private:
   DISABLE_COPY(Context)
 };
@@ -27,6 +27,7 @@
 #include "event.h"
 #include "context.h"
 #include "commandqueue.h"
+#include "completion.h"
 
 using namespace node;
 using namespace v8;
@@ -57,7 +58,7 @@ void Event::Init(Handle<Object> exports)
   exports->Set(JS_STR("WebCLEvent"), ctor->GetFunction());
 }
 
-Event::Event(Handle<Object> wrapper) : /*callback(NULL),*/ event(0), status(0)
+Event::Event(Handle<Object> wrapper) : /*callback(NULL),*/ event(0), context(0), status(0)
 {
   _type=CLObjType::Event;
 }
@@ -81,6 +82,7 @@ void Event::Destructor()
     if(count==1) {
       unregisterCLObj(this);
       this->event=0;
+      this->context=0;
     }
   }
 }
@@ -204,59 +206,49 @@ NAN_METHOD(Event::getProfilingInfo)
   }
 }
 
-void Event::setEvent(cl_event e) {
+void Event::setEvent(cl_event e, cl_context ctx) {
   Destructor();
   event=e;
+  context=ctx;
+  if(e && !ctx)
+    ::clGetEventInfo(e, CL_EVENT_CONTEXT, sizeof(cl_context), &context, NULL);
 }
 
-class EventWorker : public NanAsyncWorker {
+// delivers an event callback to JS once the CompletionQueue is drained
+class EventCompletion : public CompletionItem {
  public:
-  EventWorker(Baton *baton)
-    : NanAsyncWorker(baton->callback), baton_(baton) {
-    }
+  EventCompletion(Baton *baton) : baton_(baton) {}
 
-  ~EventWorker() {
+  ~EventCompletion() {
     if(baton_) {
-      NanScope();
       if (!baton_->data.IsEmpty()) NanDisposePersistent(baton_->data);
       if (!baton_->parent.IsEmpty()) NanDisposePersistent(baton_->parent);
-      // if (baton_->callback) delete baton_->callback;
+      if (baton_->callback) delete baton_->callback;
       delete baton_;
     }
   }
 
-  // Executed inside the worker-thread.
-  // It is not safe to access V8, or V8 data structures
-  // here, so everything we need for input and output
-  // should go on `this`.
-  void Execute () {
-    // SetErrorMessage("Error");
-    // printf("[async event] execute\n");
-  }
-
-  // Executed when the async work is complete
-  // this function will be run inside the main event loop
-  // so it is safe to use V8 again
-  void HandleOKCallback () {
+  // called on the main thread, it is safe to use V8 here
+  void Complete() {
     NanScope();
-    // printf("[async event] in HandleOKCallback\n");
+    // printf("[async event] in Complete\n");
 
     // sets event status
     Local<Object> p = NanNew(baton_->parent);
     Event *e = ObjectWrap::Unwrap<Event>(p);
-    e->setStatus(baton_->error);
+    e->setStatus(status);
 
-    // // must return passed data
+    // must return passed data
     if(baton_->data.IsEmpty()) {
-      Local<Value> argv[] = { NanNew(baton_->parent) };
-      callback->Call(1, argv);
+      Local<Value> argv[] = { p };
+      baton_->callback->Call(1, argv);
     }
     else {
       Local<Value> argv[] = {
-        NanNew(baton_->parent),  // event
+        p,                       // event
         NanNew(baton_->data)     // user's message
       };
-      callback->Call(2, argv);
+      baton_->callback->Call(2, argv);
     }
   }
 
@@ -267,11 +259,10 @@ class EventWorker : public NanAsyncWorker {
 void CL_CALLBACK Event::callback (cl_event event, cl_int event_command_exec_status, void *user_data)
 {
   // printf("[Event::callback] event=%p, exec status=%d\n",event,event_command_exec_status);
-  Baton *baton = static_cast<Baton*>(user_data);
-  baton->error = event_command_exec_status;
-
-  // printf("EventWorker launched\n");
-  NanAsyncQueueWorker(new EventWorker(baton));
+  // runs on a driver thread: hand over to the main thread without touching V8
+  EventCompletion *item = static_cast<EventCompletion*>(user_data);
+  item->status = event_command_exec_status;
+  CompletionQueue::Post(item);
 }
 
 NAN_METHOD(Event::setCallback)
@@ -285,11 +276,16 @@ NAN_METHOD(Event::setCallback)
     NanAssignPersistent(baton->data, args[2]);
   NanAssignPersistent(baton->parent, NanObjectWrapHandle(e));
   baton->callback=new NanCallback(args[1].As<Function>());
+  EventCompletion *item=new EventCompletion(baton);
 
   // printf("SetEventCallback event=%p for callback %p\n",e->getEvent(), baton->callback);
-  cl_int ret=::clSetEventCallback(e->getEvent(), command_exec_callback_type, callback, baton);
+  CommandQueue::flushForWait(e->getEvent());
+  CompletionQueue::Ref();
+  cl_int ret=::clSetEventCallback(e->getEvent(), command_exec_callback_type, callback, item);
 
   if (ret != CL_SUCCESS) {
+    CompletionQueue::Unref();
+    delete item;
     REQ_ERROR_THROW(INVALID_EVENT);
     REQ_ERROR_THROW(INVALID_VALUE);
     REQ_ERROR_THROW(OUT_OF_RESOURCES);
@@ -322,7 +318,7 @@ Event *Event::New(cl_event ew, WebCLObject *parent)
   Local<Object> obj = cons->NewInstance();
 
   Event *e = ObjectWrap::Unwrap<Event>(obj);
-  e->event = ew;
+  e->setEvent(ew);
   registerCLObj(ew, e);
 
   return e;
@@ -431,11 +427,51 @@ UserEvent *UserEvent::New(cl_event ew, WebCLObject *parent)
   Local<Object> obj = cons->NewInstance();
 
   UserEvent *e = ObjectWrap::Unwrap<UserEvent>(obj);
-  e->event = ew;
+  e->setEvent(ew);
   registerCLObj(ew, e);
 
   return e;
 }
 
 
+/********************************************
+ *
+ * EventWaitList
+ *
+ ********************************************/
+cl_int EventWaitList::build(Local<Value> arg, cl_context ctx)
+{
+  num_events_=0;
+  if(arg.IsEmpty() || arg->IsUndefined() || arg->IsNull())
+    return CL_SUCCESS;
+  if(!arg->IsArray())
+    return CL_INVALID_EVENT_WAIT_LIST;
+
+  Local<Array> arr = Local<Array>::Cast(arg);
+  cl_uint n=arr->Length();
+  if(n>INLINE_SIZE) {
+    if(events_!=inline_) delete[] events_;
+    events_=new cl_event[n];
+  }
+
+  for(cl_uint i=0;i<n;i++) {
+    Local<Value> v=arr->Get(i);
+    if(!v->IsObject())
+      return CL_INVALID_EVENT_WAIT_LIST;
+    Event *evt=ObjectWrap::Unwrap<Event>(v->ToObject());
+
+    // released events can't be waited on
+    if(!evt->getEvent())
+      return CL_INVALID_EVENT_WAIT_LIST;
+    if(evt->getStatus()<0) // for bug in Mac driver
+      return CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+    if(evt->getContext()!=ctx)
+      return CL_INVALID_CONTEXT;
+
+    events_[num_events_++]=evt->getEvent();
+  }
+
+  return CL_SUCCESS;
+}
+
 } // namespace
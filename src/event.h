@@ -49,7 +49,9 @@ public:
   static NAN_METHOD(release);
 
   cl_event getEvent() const { return event; };
-  void setEvent(cl_event e);
+  cl_context getContext() const { return context; };
+  // ctx is the context of the queue that created e, queried if NULL
+  void setEvent(cl_event e, cl_context ctx=NULL);
 
   static NAN_GETTER(GetStatus);
   void setStatus(int s) { status = s; }
@@ -68,6 +70,7 @@ protected:
   static v8::Persistent<v8::Function> constructor;
 
   cl_event event;
+  cl_context context;
   cl_int status;
 
 private:
@@ -102,6 +105,33 @@ private:
   DISABLE_COPY(UserEvent)
 };
 
+// Builds the cl_event array for an enqueue call from a JS array of
+// WebCLEvent. Short lists are kept inline so the common case does not
+// allocate.
+class EventWaitList
+{
+public:
+  EventWaitList() : events_(inline_), num_events_(0) {}
+  ~EventWaitList() { if(events_!=inline_) delete[] events_; }
+
+  // fills the list from arg (undefined, null or array of WebCLEvent) and
+  // checks each event belongs to ctx. Returns CL_SUCCESS or a CL error code.
+  cl_int build(v8::Local<v8::Value> arg, cl_context ctx);
+
+  cl_uint size() const { return num_events_; }
+  const cl_event *data() const { return num_events_ ? events_ : NULL; }
+
+private:
+  static const cl_uint INLINE_SIZE=16;
+
+  cl_event inline_[INLINE_SIZE];
+  cl_event *events_;
+  cl_uint num_events_;
+
+private:
+  DISABLE_COPY(EventWaitList)
+};
+
 } // namespace
 
 #endif
@@ -60,7 +60,7 @@ void Kernel::Init(Handle<Object> exports)
   exports->Set(NanNew<String>("WebCLKernel"), ctor->GetFunction());
 }
 
-Kernel::Kernel(Handle<Object> wrapper) : kernel(0)
+Kernel::Kernel(Handle<Object> wrapper) : kernel(0), context(0)
 {
   _type=CLObjType::Kernel;
 }
@@ -83,6 +83,7 @@ void Kernel::Destructor() {
     if(count==1) {
       unregisterCLObj(this);
       kernel=0;
+      context=0;
     }
   }
 }
@@ -489,6 +490,7 @@ Kernel *Kernel::New(cl_kernel kw, WebCLObject *parent)
 
   Kernel *kernel = ObjectWrap::Unwrap<Kernel>(obj);
   kernel->kernel = kw;
+  ::clGetKernelInfo(kw, CL_KERNEL_CONTEXT, sizeof(cl_context), &kernel->context, NULL);
   registerCLObj(kw, kernel);
 
   return kernel;
@@ -48,6 +48,7 @@ public:
   static NAN_METHOD(release);
 
   cl_kernel getKernel() const { return kernel; };
+  cl_context getContext() const { return context; };
 
   virtual bool operator==(void *clObj) { return ((cl_kernel)clObj)==kernel; }
 
@@ -58,6 +59,7 @@ private:
   static v8::Persistent<v8::Function> constructor;
 
   cl_kernel kernel;
+  cl_context context;
 
 private:
   DISABLE_COPY(Kernel)
@@ -26,6 +26,8 @@
 
 #include "memoryobject.h"
 #include "context.h"
+#include "cl_checks.h"
+#include "completion.h"
 #include <node_buffer.h>
 
 using namespace v8;
@@ -53,7 +55,7 @@ void MemoryObject::Init(Handle<Object> exports)
   exports->Set(NanNew<String>("WebCLMemoryObject"), ctor->GetFunction());
 }
 
-MemoryObject::MemoryObject(Handle<Object> wrapper) : memory(0)
+MemoryObject::MemoryObject(Handle<Object> wrapper) : memory(0), context(0)
 {
   _type=CLObjType::MemoryObject;
 }
@@ -63,9 +65,21 @@ MemoryObject::~MemoryObject() {
   printf("In ~MemoryObject\n");
 #endif
   // Destructor();
+
+  // may run from a GC callback: no handles and no enqueues here. The memory
+  // object is not released by GC, so the views stay valid.
+  for(size_t i=0;i<mappings.size();i++) {
+    delete mappings[i]->view;
+    ::clReleaseCommandQueue(mappings[i]->queue);
+    delete mappings[i];
+  }
+  mappings.clear();
 }
 
 void MemoryObject::Destructor() {
+  // views of this object must not outlive it
+  unmapAll();
+
   if(memory) {
     cl_uint count;
     ::clGetMemObjectInfo(memory,CL_MEM_REFERENCE_COUNT,sizeof(cl_uint),&count,NULL);
@@ -76,10 +90,145 @@ void MemoryObject::Destructor() {
     if(count==1) {
       unregisterCLObj(this);
       memory=0;
+      context=0;
     }
   }
 }
 
+void MemoryObject::setMemory(cl_mem mw)
+{
+  memory=mw;
+  ::clGetMemObjectInfo(mw, CL_MEM_CONTEXT, sizeof(cl_context), &context, NULL);
+}
+
+static void mapped_free_callback(char *data, void *hint) {
+  // the memory belongs to the driver, collected views are unmapped instead
+}
+
+// unmaps a region whose view was collected. Posted from the GC callback,
+// which must not enqueue, and completed on the main loop.
+class UnmapItem : public CompletionItem {
+ public:
+  UnmapItem(cl_command_queue queue, cl_mem memory, void *ptr)
+    : queue(queue), memory(memory), ptr(ptr) {
+    ::clRetainCommandQueue(queue);
+    ::clRetainMemObject(memory);
+  }
+
+  ~UnmapItem() {
+    ::clReleaseMemObject(memory);
+    ::clReleaseCommandQueue(queue);
+  }
+
+  void Complete() {
+    status=::clEnqueueUnmapMemObject(queue, memory, ptr, 0, NULL, NULL);
+    if(status==CL_SUCCESS)
+      ::clFlush(queue);
+  }
+
+ private:
+  cl_command_queue queue;
+  cl_mem memory;
+  void *ptr;
+};
+
+NAN_WEAK_CALLBACK(MappedViewCollected)
+{
+  MappedRegion *region=data.GetParameter();
+  region->owner->collectMapping(region);
+}
+
+// makes view unusable, reading or writing it no longer touches the mapped memory
+static void detachView(Local<Object> view) {
+  view->SetIndexedPropertiesToExternalArrayData(NULL, kExternalUnsignedByteArray, 0);
+}
+
+Local<Object> MemoryObject::addMapping(cl_command_queue queue, void *ptr, size_t size)
+{
+  // WARNING: make sure result is shared not copied, otherwise unmap won't work
+  Local<Object> buf=NanNewBufferHandle((char*) ptr, size, mapped_free_callback, NULL);
+  if(node::Buffer::Data(buf) != ptr) {
+    printf("WARNING: data buffer has been copied\n");
+  }
+
+  MappedRegion *region=new MappedRegion();
+  region->ptr=ptr;
+  region->size=size;
+  region->queue=queue;
+  region->owner=this;
+  ::clRetainCommandQueue(queue);
+  region->view=NanMakeWeakPersistent(buf, region, &MappedViewCollected);
+  mappings.push_back(region);
+
+  return buf;
+}
+
+MappedRegion *MemoryObject::findMapping(cl_command_queue queue, Local<Object> view) const
+{
+  if(!node::Buffer::HasInstance(view))
+    return NULL;
+  void *ptr=node::Buffer::Data(view);
+  for(size_t i=0;i<mappings.size();i++) {
+    MappedRegion *region=mappings[i];
+    if(region->ptr == ptr && region->queue == queue && NanNew(region->view->persistent)->StrictEquals(view))
+      return region;
+  }
+  return NULL;
+}
+
+void MemoryObject::removeMapping(MappedRegion *region)
+{
+  for(size_t i=0;i<mappings.size();i++) {
+    if(mappings[i] != region)
+      continue;
+
+    detachView(NanNew(region->view->persistent));
+    delete region->view;
+    ::clReleaseCommandQueue(region->queue);
+    delete region;
+    mappings.erase(mappings.begin()+i);
+    return;
+  }
+}
+
+void MemoryObject::collectMapping(MappedRegion *region)
+{
+  for(size_t i=0;i<mappings.size();i++) {
+    if(mappings[i] != region)
+      continue;
+
+    // the weak handle is disposed by the caller, nothing can see the view
+    if(memory) {
+      CompletionQueue::Ref();
+      CompletionQueue::Post(new UnmapItem(region->queue, memory, region->ptr));
+    }
+    ::clReleaseCommandQueue(region->queue);
+    delete region;
+    mappings.erase(mappings.begin()+i);
+    return;
+  }
+}
+
+void MemoryObject::unmapAll()
+{
+  if(mappings.empty())
+    return;
+
+  NanScope();
+  for(size_t i=0;i<mappings.size();i++) {
+    MappedRegion *region=mappings[i];
+    if(memory) {
+      ::clEnqueueUnmapMemObject(region->queue, memory, region->ptr, 0, NULL, NULL);
+      ::clFlush(region->queue);
+    }
+    detachView(NanNew(region->view->persistent));
+    delete region->view;
+    ::clReleaseCommandQueue(region->queue);
+    delete region;
+  }
+  mappings.clear();
+}
+
 NAN_METHOD(MemoryObject::release)
 {
   NanScope();
@@ -139,7 +288,7 @@ NAN_METHOD(MemoryObject::getInfo)
       return NanThrowError("UNKNOWN ERROR");
     }
 
-    NanReturnValue(JS_INT((int32_t)param_value));
+    NanReturnValue(JS_NUM((double)param_value));
   }
   case CL_MEM_ASSOCIATED_MEMOBJECT: {
     cl_mem param_value=NULL;
@@ -248,7 +397,7 @@ MemoryObject *MemoryObject::New(cl_mem mw)
   Local<Object> obj = cons->NewInstance();
 
   MemoryObject *memobj = ObjectWrap::Unwrap<MemoryObject>(obj);
-  memobj->memory = mw;
+  memobj->setMemory(mw);
   registerCLObj(mw, memobj);
 
   return memobj;
@@ -331,10 +480,16 @@ NAN_METHOD(WebCLBuffer::createSubBuffer)
   }
 
   cl_buffer_region region;
-  region.origin = args[1]->Uint32Value();
-  region.size = args[2]->Uint32Value();
+  if(!getSizeValue(args[1], region.origin) || !getSizeValue(args[2], region.size)) {
+    ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+    NanReturnNull();
+  }
 
-  if(region.origin>=region.size) {
+  // region must be non-empty and lie within the parent buffer
+  size_t parent_size=0;
+  ::clGetMemObjectInfo(mo->getMemory(),CL_MEM_SIZE,sizeof(size_t),&parent_size,NULL);
+  if(region.size==0 || region.origin>parent_size || region.size>parent_size-region.origin) {
     ret=CL_INVALID_VALUE;
     REQ_ERROR_THROW(INVALID_VALUE);
     NanReturnNull();
@@ -386,7 +541,7 @@ WebCLBuffer *WebCLBuffer::New(cl_mem mw, WebCLObject *parent)
   Local<Object> obj = cons->NewInstance();
 
   WebCLBuffer *memobj = ObjectWrap::Unwrap<WebCLBuffer>(obj);
-  memobj->memory = mw;
+  memobj->setMemory(mw);
   registerCLObj(mw, memobj);
 
   return memobj;
@@ -512,7 +667,7 @@ WebCLImage *WebCLImage::New(cl_mem mw, WebCLObject *parent)
   Local<Object> obj = cons->NewInstance();
 
   WebCLImage *memobj = ObjectWrap::Unwrap<WebCLImage>(obj);
-  memobj->memory = mw;
+  memobj->setMemory(mw);
   registerCLObj(mw, memobj);
 
   return memobj;
@@ -28,9 +28,26 @@
 #define MEMORYOBJECT_H_
 
 #include "common.h"
+#include <vector>
 
 namespace webcl {
 
+class MemoryObject;
+
+// a host region returned by one enqueueMapBuffer/enqueueMapImage call,
+// exposed to JS as a zero-copy Buffer until it is unmapped. Mapping the same
+// range twice gives two regions with the same ptr, told apart by their view.
+// Unmapping detaches the view itself only: slices and typed arrays taken from
+// it still point to the region and must not be used afterwards. The view is
+// held weakly: once it is collected, the region is unmapped on the main loop.
+struct MappedRegion {
+  void *ptr;
+  size_t size;
+  cl_command_queue queue; // retained, used to unmap on release
+  MemoryObject *owner;
+  _NanWeakCallbackInfo<v8::Object, MappedRegion> *view;
+};
+
 class MemoryObject : public WebCLObject
 {
 
@@ -46,8 +63,20 @@ public:
   static NAN_METHOD(release);
 
   cl_mem getMemory() const { return memory; };
+  cl_context getContext() const { return context; };
   virtual bool operator==(void *clObj) { return ((cl_mem)clObj)==memory; }
 
+  // registers a region mapped on queue and returns its zero-copy view
+  v8::Local<v8::Object> addMapping(cl_command_queue queue, void *ptr, size_t size);
+  // @return the region mapped on queue whose view is view, NULL if none
+  MappedRegion *findMapping(cl_command_queue queue, v8::Local<v8::Object> view) const;
+  // forgets an unmapped region and detaches its view
+  void removeMapping(MappedRegion *region);
+  // main thread: unmaps all regions still mapped and detaches their views
+  void unmapAll();
+  // GC: the view of region was collected, unmaps it later on the main loop
+  void collectMapping(MappedRegion *region);
+
 private:
   static v8::Persistent<v8::Function> constructor;
 
@@ -55,7 +84,12 @@ protected:
   MemoryObject(v8::Handle<v8::Object> wrapper);
   ~MemoryObject();
 
+  // caches the owning context of memory
+  void setMemory(cl_mem mw);
+
   cl_mem memory;
+  cl_context context;
+  std::vector<MappedRegion*> mappings;
 
 private:
   DISABLE_COPY(MemoryObject)
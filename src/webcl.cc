@@ -30,6 +30,7 @@
 #include "device.h"
 #include "event.h"
 #include "commandqueue.h"
+#include "completion.h"
 
 #include <list>
 #include <vector>
@@ -420,11 +421,17 @@ NAN_METHOD(createContext) {
 
 class WaitForEventsWorker : public NanAsyncWorker {
  public:
-  WaitForEventsWorker(Baton *baton)
-    : NanAsyncWorker(baton->callback), baton_(baton) {
+  WaitForEventsWorker(Baton *baton, const std::vector<cl_event> &events)
+    : NanAsyncWorker(baton->callback), baton_(baton), events_(events) {
+      // retain the snapshot so the handles stay valid on the worker thread,
+      // even if the WebCLEvent objects are released in the meantime
+      for(size_t i=0;i<events_.size();i++)
+        ::clRetainEvent(events_[i]);
     }
 
   ~WaitForEventsWorker() {
+    for(size_t i=0;i<events_.size();i++)
+      ::clReleaseEvent(events_[i]);
     if(baton_) {
       NanScope();
       if (!baton_->parent.IsEmpty()) NanDisposePersistent(baton_->parent);
@@ -439,8 +446,11 @@ class WaitForEventsWorker : public NanAsyncWorker {
   // here, so everything we need for input and output
   // should go on `this`.
   void Execute () {
-    // SetErrorMessage("Error");
     // printf("[async event] execute\n");
+    if(events_.empty())
+      baton_->error = CL_INVALID_VALUE;
+    else
+      baton_->error = ::clWaitForEvents( (cl_uint) events_.size(), &events_.front());
   }
 
   // Executed when the async work is complete
@@ -449,15 +459,6 @@ class WaitForEventsWorker : public NanAsyncWorker {
   void HandleOKCallback () {
     NanScope();
 
-    Local<Array> eventsArray = Local<Array>::Cast(NanNew(baton_->data));
-    std::vector<cl_event> events;
-    for (uint32_t i=0; i<eventsArray->Length(); i++) {
-     Event *we=ObjectWrap::Unwrap<Event>(eventsArray->Get(i)->ToObject());
-      cl_event e = we->getEvent();
-      events.push_back(e);
-    }
-    baton_->error = ::clWaitForEvents( (int) events.size(), &events.front());
-
     // must return passed data
     Local<Value> argv[] = {
       JS_INT(baton_->error)
@@ -469,20 +470,36 @@ class WaitForEventsWorker : public NanAsyncWorker {
 
   private:
     Baton *baton_;
+    std::vector<cl_event> events_;
 };
 
 NAN_METHOD(waitForEvents) {
   NanScope();
 
   if (!args[0]->IsArray())
-    NanThrowError("INVALID_VALUE");
+    return NanThrowError("INVALID_VALUE");
 
   if(args[1]->IsFunction()) {
-      Baton *baton=new Baton();
-      NanAssignPersistent(baton->data, args[0]);
-      baton->callback=new NanCallback(args[1].As<Function>());
-      NanAsyncQueueWorker(new WaitForEventsWorker(baton));
-      NanReturnUndefined();
+    // snapshot the cl_event handles while we are still on the JS thread
+    Local<Array> eventsArray = Local<Array>::Cast(args[0]);
+    std::vector<cl_event> events;
+    events.reserve(eventsArray->Length());
+    for (uint32_t i=0; i<eventsArray->Length(); i++) {
+      Event *we=ObjectWrap::Unwrap<Event>(eventsArray->Get(i)->ToObject());
+      cl_event e = we->getEvent();
+      if(!e) {
+        cl_int ret=CL_INVALID_EVENT;
+        REQ_ERROR_THROW(INVALID_EVENT);
+      }
+      events.push_back(e);
+      CommandQueue::flushForWait(e);
+    }
+
+    Baton *baton=new Baton();
+    NanAssignPersistent(baton->data, args[0]);
+    baton->callback=new NanCallback(args[1].As<Function>());
+    NanAsyncQueueWorker(new WaitForEventsWorker(baton, events));
+    NanReturnUndefined();
   }
 
   Local<Array> eventsArray = Local<Array>::Cast(args[0]);
@@ -491,6 +508,7 @@ NAN_METHOD(waitForEvents) {
     Event *we=ObjectWrap::Unwrap<Event>(eventsArray->Get(i)->ToObject());
     cl_event e = we->getEvent();
     events.push_back(e);
+    CommandQueue::flushForWait(e);
   }
 
   // printf("Waiting for %d events\n",events.size());
@@ -510,6 +528,229 @@ NAN_METHOD(waitForEvents) {
   NanReturnUndefined();
 }
 
+// One completion registration for many events. Driver threads record which
+// events completed; the main thread hears of it through as few
+// CompletionQueue items as possible and calls JS once when all events are
+// done, or with batches of completed indices at most every batch_ms.
+class CompletionAggregate {
+ public:
+  // user data of each event's callback
+  struct Slot {
+    CompletionAggregate *aggregate;
+    uint32_t index;
+  };
+
+  CompletionAggregate(Handle<Array> events, Handle<Function> callback, bool batched, uint32_t batch_ms)
+    : slots_(events->Length()), callback_(new NanCallback(callback)),
+      batched_(batched), batch_ms_(batch_ms), status_(CL_COMPLETE),
+      recorded_(0), posted_(false), delivered_(0), last_delivery_(0), timer_(NULL)
+  {
+    NanAssignPersistent(events_, events);
+    uv_mutex_init(&mutex_);
+    for(uint32_t i=0; i<slots_.size(); i++) {
+      slots_[i].aggregate=this;
+      slots_[i].index=i;
+    }
+    // keeps the loop alive until the last completion is delivered
+    CompletionQueue::Ref();
+  }
+
+  ~CompletionAggregate() {
+    NanDisposePersistent(events_);
+    delete callback_;
+    uv_mutex_destroy(&mutex_);
+  }
+
+  uint32_t size() const { return (uint32_t) slots_.size(); }
+
+  // main thread, before any callback is registered: event i will never
+  // complete, e.g. clSetEventCallback failed
+  void fail(uint32_t i, cl_int status) {
+    record(i, status);
+  }
+
+  cl_int registerEvent(uint32_t i, cl_event event) {
+    return ::clSetEventCallback(event, CL_COMPLETE, callback, &slots_[i]);
+  }
+
+ private:
+  class Item : public CompletionItem {
+   public:
+    Item(CompletionAggregate *aggregate) : aggregate_(aggregate) { counted=false; }
+    void Complete() { aggregate_->drained(); }
+   private:
+    CompletionAggregate *aggregate_;
+  };
+
+  static void CL_CALLBACK callback(cl_event event, cl_int status, void *user_data)
+  {
+    // driver thread, V8 can't be used here
+    Slot *slot=static_cast<Slot*>(user_data);
+    slot->aggregate->record(slot->index, status);
+  }
+
+  // any thread
+  void record(uint32_t index, cl_int status) {
+    uv_mutex_lock(&mutex_);
+    indices_.push_back(index);
+    statuses_.push_back(status);
+    recorded_++;
+    // an item already on its way will pick this one up
+    bool post=!posted_ && (batched_ || recorded_==slots_.size());
+    if(post) posted_=true;
+    uv_mutex_unlock(&mutex_);
+    if(post)
+      CompletionQueue::Post(new Item(this));
+  }
+
+  // main thread
+  void drained() {
+    uv_mutex_lock(&mutex_);
+    ready_indices_.insert(ready_indices_.end(), indices_.begin(), indices_.end());
+    ready_statuses_.insert(ready_statuses_.end(), statuses_.begin(), statuses_.end());
+    indices_.clear();
+    statuses_.clear();
+    posted_=false;
+    bool done=(recorded_==slots_.size());
+    uv_mutex_unlock(&mutex_);
+
+    if(done || !batch_ms_ || uv_now(uv_default_loop())-last_delivery_>=batch_ms_) {
+      deliver();
+      return;
+    }
+    if(!timer_) {
+      timer_=new uv_timer_t();
+      uv_timer_init(uv_default_loop(), timer_);
+      timer_->data=this;
+    }
+    if(!uv_is_active((uv_handle_t*) timer_))
+      uv_timer_start(timer_, OnTimer, batch_ms_-(uv_now(uv_default_loop())-last_delivery_), 0);
+  }
+
+#if NODE_MODULE_VERSION > 0x000B
+  static void OnTimer(uv_timer_t *handle)
+#else
+  static void OnTimer(uv_timer_t *handle, int status)
+#endif
+  {
+    static_cast<CompletionAggregate*>(handle->data)->deliver();
+  }
+
+  static void OnTimerClose(uv_handle_t *handle) {
+    delete static_cast<CompletionAggregate*>(handle->data);
+    delete (uv_timer_t*) handle;
+  }
+
+  // main thread: hands the ready completions to JS
+  void deliver() {
+    NanScope();
+    if(timer_) uv_timer_stop(timer_);
+    last_delivery_=uv_now(uv_default_loop());
+
+    size_t n=ready_indices_.size();
+    Local<Array> events=NanNew(events_);
+    for(size_t i=0; i<n; i++) {
+      Local<Value> e=events->Get(ready_indices_[i]);
+      if(e->IsObject())
+        ObjectWrap::Unwrap<Event>(e->ToObject())->setStatus(ready_statuses_[i]);
+      if(ready_statuses_[i]<0 && status_==CL_COMPLETE)
+        status_=ready_statuses_[i];
+    }
+    delivered_+=n;
+    bool done=(delivered_==slots_.size());
+
+    if(batched_ && n) {
+      Local<Array> indices=Array::New((int) n), statuses=Array::New((int) n);
+      for(size_t i=0; i<n; i++) {
+        indices->Set((uint32_t) i, JS_INT(ready_indices_[i]));
+        statuses->Set((uint32_t) i, JS_INT(ready_statuses_[i]));
+      }
+      Local<Value> argv[] = { indices, statuses, NanNew<Boolean>(done) };
+      ready_indices_.clear();
+      ready_statuses_.clear();
+      callback_->Call(3, argv);
+    }
+    else if(!batched_ && done) {
+      Local<Value> argv[] = { JS_INT(status_) };
+      ready_indices_.clear();
+      ready_statuses_.clear();
+      callback_->Call(1, argv);
+    }
+
+    if(done) {
+      CompletionQueue::Unref();
+      if(timer_)
+        uv_close((uv_handle_t*) timer_, OnTimerClose);
+      else
+        delete this;
+    }
+  }
+
+  std::vector<Slot> slots_;
+  Persistent<Array> events_;
+  NanCallback *callback_;
+  bool batched_;
+  uint32_t batch_ms_;
+  cl_int status_;  // first failure, or CL_COMPLETE
+
+  // shared with driver threads
+  uv_mutex_t mutex_;
+  std::vector<uint32_t> indices_;
+  std::vector<cl_int> statuses_;
+  size_t recorded_;
+  bool posted_;
+
+  // main thread only
+  std::vector<uint32_t> ready_indices_;
+  std::vector<cl_int> ready_statuses_;
+  size_t delivered_;
+  uint64_t last_delivery_;
+  uv_timer_t *timer_;
+};
+
+// onComplete(WebCLEvent[] events, callback, batched, batch_ms)
+NAN_METHOD(onComplete) {
+  NanScope();
 
+  if (!args[0]->IsArray() || !args[1]->IsFunction()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+  }
+
+  Local<Array> eventsArray = Local<Array>::Cast(args[0]);
+  std::vector<cl_event> events;
+  events.reserve(eventsArray->Length());
+  for (uint32_t i=0; i<eventsArray->Length(); i++) {
+    Local<Value> value=eventsArray->Get(i);
+    cl_event e=NULL;
+    if(value->IsObject())
+      e=ObjectWrap::Unwrap<Event>(value->ToObject())->getEvent();
+    if(!e) {
+      cl_int ret=CL_INVALID_EVENT;
+      REQ_ERROR_THROW(INVALID_EVENT);
+    }
+    events.push_back(e);
+  }
+  if(events.empty()) {
+    cl_int ret=CL_INVALID_VALUE;
+    REQ_ERROR_THROW(INVALID_VALUE);
+  }
+
+  // failures are recorded after the loop, so the aggregate can't complete
+  // while events are still being registered
+  CompletionAggregate *aggregate=new CompletionAggregate(eventsArray, args[1].As<Function>(),
+                                                         args[2]->BooleanValue(), args[3]->Uint32Value());
+  std::vector<std::pair<uint32_t, cl_int> > failed;
+  for(uint32_t i=0; i<events.size(); i++) {
+    CommandQueue::flushForWait(events[i]);
+    cl_int ret=aggregate->registerEvent(i, events[i]);
+    if(ret!=CL_SUCCESS)
+      failed.push_back(std::make_pair(i, ret));
+  }
+  for(size_t i=0; i<failed.size(); i++)
+    aggregate->fail(failed[i].first, failed[i].second);
+
+  NanReturnUndefined();
+}
 
 }
@@ -38,6 +38,7 @@ NAN_METHOD(createContext);
 // NAN_METHOD(getSupportedExtensions);
 // NAN_METHOD(enableExtension);
 NAN_METHOD(waitForEvents);
+NAN_METHOD(onComplete);
 NAN_METHOD(releaseAll);
 
 }
@@ -0,0 +1,113 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Backpressure: a producer streams non-blocking writes of fresh host arrays
+// into a device buffer, waiting on queue.drain() whenever the in-flight
+// bytes reach the high-water mark. The host arrays are dropped right after
+// each write, so the queue must keep them alive until their transfer ends.
+//
+// usage: node backpressure.js [MB to stream]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var CHUNK=1<<20;
+var TOTAL=(parseInt(process.argv[2]) || 256)*CHUNK;
+var HIGH_WATER=16*CHUNK;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var SLOTS=64;
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, SLOTS*CHUNK);
+queue.setHighWaterMark({ bytes: HIGH_WATER });
+
+var waits=0;
+var start=process.hrtime();
+
+function produce(sent) {
+  while(sent<TOTAL) {
+    if(queue.getInFlight().aboveHighWater) {
+      waits++;
+      return queue.drain().then(function () { return produce(sent); });
+    }
+    var chunk=new Uint8Array(CHUNK);
+    chunk.fill((sent/CHUNK) & 0xff);
+    queue.enqueueWriteBuffer(buffer, false, (sent/CHUNK % SLOTS)*CHUNK, CHUNK, chunk);
+    sent+=CHUNK;
+  }
+  return queue.drain();
+}
+
+produce(0).then(function () {
+  queue.finish();
+  var diff=process.hrtime(start);
+  var stats=queue.getInFlight();
+  assert.ok(stats.peakBytes<=HIGH_WATER, 'peak '+stats.peakBytes+' above the high-water mark');
+
+  // the last SLOTS chunks are still in the buffer
+  var host=new Uint8Array(CHUNK);
+  var first=TOTAL/CHUNK-SLOTS;
+  for(var c=first;c<TOTAL/CHUNK;c++) {
+    queue.enqueueReadBuffer(buffer, true, (c % SLOTS)*CHUNK, CHUNK, host);
+    assert.equal(host[0], c & 0xff, 'chunk '+c);
+    assert.equal(host[CHUNK-1], c & 0xff, 'chunk '+c);
+  }
+  // finish() retired every transfer, without waiting for the callbacks
+  assert.equal(queue.getInFlight().commands, 0);
+
+  // without limits, transfers are still counted and their arrays kept alive
+  queue.setHighWaterMark(null);
+  for(var c=0;c<4;c++) {
+    var chunk=new Uint8Array(CHUNK);
+    chunk.fill(0xa5);
+    queue.enqueueWriteBuffer(buffer, false, c*CHUNK, CHUNK, chunk);
+  }
+  chunk=null;
+  assert.equal(queue.getInFlight().commands, 4);
+  if(global.gc) gc();
+  queue.finish();
+  assert.equal(queue.getInFlight().bytes, 0);
+  for(var c=0;c<4;c++) {
+    queue.enqueueReadBuffer(buffer, true, c*CHUNK, CHUNK, host);
+    assert.equal(host[CHUNK-1], 0xa5, 'unlimited chunk '+c);
+  }
+
+  var ms=diff[0]*1e3+diff[1]/1e6;
+  log('streamed '+(TOTAL/CHUNK)+' MB in '+ms.toFixed(1)+' ms ('+(TOTAL/CHUNK/ms*1e3).toFixed(0)+' MB/s), '+
+      waits+' waits, peak in flight '+(stats.peakBytes/CHUNK)+' MB');
+
+  webcl.releaseAll();
+});
@@ -0,0 +1,82 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// CompletionQueue: callbacks of many events completing close together each
+// run exactly once, delivered in batches, so they arrive in far fewer event
+// loop turns than there are events.
+//
+// usage: node completion_queue.js [events]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var EVENTS=parseInt(process.argv[2]) || 1000;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var events=[], calls=new Array(EVENTS), received=0;
+for(var i=0;i<EVENTS;i++) {
+  calls[i]=0;
+  var ev=context.createUserEvent();
+  ev.setCallback(webcl.COMPLETE, function(event, index) {
+    calls[index]++;
+    received++;
+  }, i);
+  events.push(ev);
+}
+
+// complete them all at once, then count loop turns until every callback ran
+for(var i=0;i<EVENTS;i++)
+  events[i].setStatus(webcl.COMPLETE);
+
+var turns=0;
+function tick() {
+  turns++;
+  if(received<EVENTS) {
+    assert(turns<EVENTS, 'only '+received+' of '+EVENTS+' callbacks after '+turns+' turns');
+    return setImmediate(tick);
+  }
+  // a late duplicate would show up within a few more turns
+  setTimeout(function() {
+    for(var i=0;i<EVENTS;i++)
+      assert.equal(calls[i], 1, 'callback '+i+' ran '+calls[i]+' times');
+    assert.equal(received, EVENTS);
+    log(EVENTS+' callbacks in '+turns+' loop turns');
+    events.forEach(function(ev) { ev.release(); });
+    webcl.releaseAll();
+  }, 50);
+}
+setImmediate(tick);
@@ -0,0 +1,94 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Splits one NDRange across every device of the first platform with
+// WebCLDispatcher, checks the result, and shows how the chunks and the
+// output regions ended up distributed between devices.
+//
+// usage: node dispatcher.js [width] [height]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var W=parseInt(process.argv[2]) || 1024;
+var H=parseInt(process.argv[3]) || 4096;
+
+var platform=webcl.getPlatforms()[0];
+var devices=platform.getDevices(webcl.DEVICE_TYPE_ALL);
+var context=webcl.createContext(devices);
+var queues=devices.map(function(device) {
+  log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+  return context.createCommandQueue(device);
+});
+
+var program=context.createProgram([
+"__kernel void fill(__global float *out, uint w)                  ",
+"{                                                                ",
+"  size_t x = get_global_id(0), y = get_global_id(1);             ",
+"  float v = 0;                                                   ",
+"  for(int i = 0; i < 64; i++) v += sin(x * 0.01f + y * i);       ",
+"  out[y * w + x] = y + (v > 1e30f ? 1 : 0);                      ",
+"}                                                                "
+].join("\n"));
+program.build(devices);
+var kernel=program.createKernel('fill');
+
+var out=context.createBuffer(webcl.MEM_WRITE_ONLY, W*H*4);
+kernel.setArg(0, out);
+kernel.setArg(1, new Uint32Array([W]));
+
+var dispatcher=new webcl.WebCLDispatcher(queues);
+dispatcher.enqueueNDRangeKernel(kernel, 2, null, [W, H], [16, 16], {
+  regions: [ { buffer: out, elementSize: 4 } ]
+}, function(err, report) {
+  assert.ifError(err);
+  log(report.chunks+' chunks of '+report.chunkSize+' rows in '+(report.seconds*1e3).toFixed(2)+' ms');
+
+  var host=new Float32Array(W*H), covered=0;
+  report.devices.forEach(function(d) {
+    log('  '+d.device.getInfo(webcl.DEVICE_NAME)+': '+d.chunks+' chunks ('+d.stolen+' stolen), '+d.items+' work-items');
+    // read back each region from the device that wrote it
+    d.regions[0].ranges.forEach(function(r) {
+      log('    bytes ['+r.offset+', '+(r.offset+r.size)+')');
+      var view=new Float32Array(host.buffer, r.offset, r.size/4);
+      d.queue.enqueueReadBuffer(out, true, r.offset, r.size, view);
+      covered+=r.size;
+    });
+  });
+  assert.equal(covered, W*H*4);
+
+  for(var y=0;y<H;y+=17)
+    assert.equal(host[y*W + (y % W)], y);
+
+  webcl.releaseAll();
+});
@@ -0,0 +1,121 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Host-side overhead of enqueue calls: time spent in JS + native binding +
+// driver per command. Best run against a CPU OpenCL ICD (e.g. pocl) so that
+// device work is negligible compared with the host path.
+//
+//   node test/enqueue_overhead.js [cpu|gpu|all] [iterations]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var deviceTypes = {
+  cpu: webcl.DEVICE_TYPE_CPU,
+  gpu: webcl.DEVICE_TYPE_GPU,
+  all: webcl.DEVICE_TYPE_ALL
+};
+var deviceType = deviceTypes[process.argv[2] || 'cpu'] || webcl.DEVICE_TYPE_CPU;
+var ITERATIONS = parseInt(process.argv[3] || '20000', 10);
+var BATCH      = 1000;   // commands between two finish()
+
+var context=webcl.createContext(deviceType);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME)+
+    ' ('+device.getInfo(webcl.DEVICE_VERSION)+')');
+
+var program=context.createProgram("__kernel void nop(__global int *a) { }");
+program.build(device);
+var kernel=program.createKernel('nop');
+
+var SIZE=1024;
+var src=context.createBuffer(webcl.MEM_READ_WRITE, SIZE);
+var dst=context.createBuffer(webcl.MEM_READ_WRITE, SIZE);
+var host=new Uint8Array(SIZE);
+kernel.setArg(0, src);
+
+// completed events used as wait lists
+var waitList=[];
+for(var i=0;i<16;i++) {
+  var ev=new webcl.WebCLEvent();
+  queue.enqueueMarker(ev);
+  waitList.push(ev);
+}
+queue.finish();
+var waitList4=waitList.slice(0,4);
+
+// time fn() over ITERATIONS calls, draining the queue every BATCH calls
+// outside of the measured region
+function bench(name, fn) {
+  var elapsed=0;
+  for(var done=0; done<ITERATIONS; done+=BATCH) {
+    var start=process.hrtime();
+    for(var i=0;i<BATCH;i++)
+      fn(i);
+    var d=process.hrtime(start);
+    elapsed+=d[0]*1e9 + d[1];
+    queue.finish();
+  }
+  log('  '+name+': '+(elapsed/ITERATIONS/1e3).toFixed(3)+' us/call');
+}
+
+var cases = {
+  'enqueueNDRangeKernel 1D': function() {
+    queue.enqueueNDRangeKernel(kernel, 1, null, [64], null);
+  },
+  'enqueueNDRangeKernel 1D, 4 events wait list': function() {
+    queue.enqueueNDRangeKernel(kernel, 1, null, [64], null, waitList4);
+  },
+  'enqueueNDRangeKernel 1D, 16 events wait list': function() {
+    queue.enqueueNDRangeKernel(kernel, 1, null, [64], null, waitList);
+  },
+  'enqueueWriteBuffer 4B':   function() {
+    queue.enqueueWriteBuffer(src, false, 0, 4, host);
+  },
+  'enqueueReadBuffer 4B':    function() {
+    queue.enqueueReadBuffer(src, false, 0, 4, host);
+  },
+  'enqueueCopyBuffer 4B':    function() {
+    queue.enqueueCopyBuffer(src, dst, 0, 0, 4);
+  },
+};
+
+// warm up the driver
+for(var name in cases)
+  cases[name]();
+queue.finish();
+
+log('Enqueue overhead over '+ITERATIONS+' calls');
+for(var name in cases)
+  bench(name, cases[name]);
+
+webcl.releaseAll();
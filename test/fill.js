@@ -0,0 +1,125 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Buffer and image fills: checks enqueueFillBuffer with several pattern
+// sizes and alignments and enqueueFillImage on a 2D image, then compares the
+// time to clear a large buffer with a fill against writing zeros from host.
+//
+// usage: node fill.js [MB]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var MB=parseInt(process.argv[2]) || 64;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+log('device version: '+device.getInfo(webcl.DEVICE_VERSION));
+
+// pattern sizes and regions, including unaligned ones that use the byte kernel
+var N=4096;
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, N);
+var host=new Uint8Array(N);
+var cases=[
+  { pattern: new Uint8Array([0x5a]),             offset: 0,   size: N },
+  { pattern: new Uint8Array([1,2,3,4]),          offset: 64,  size: 1024 },
+  { pattern: new Uint16Array([0xbeef]),          offset: 6,   size: 10 },
+  { pattern: new Float32Array([1,2,3,4,5,6,7,8]), offset: 128, size: 256 },
+  { pattern: new Uint8Array([9]),                offset: 3,   size: 5 }
+];
+cases.forEach(function(c) {
+  var zeros=new Uint8Array(N);
+  queue.enqueueWriteBuffer(buffer, true, 0, N, zeros);
+  queue.enqueueFillBuffer(buffer, c.pattern, c.offset, c.size);
+  queue.enqueueReadBuffer(buffer, true, 0, N, host);
+
+  var p=new Uint8Array(c.pattern.buffer, c.pattern.byteOffset, c.pattern.byteLength);
+  for(var i=0;i<N;i++) {
+    var expected=(i>=c.offset && i<c.offset+c.size) ? p[(i-c.offset)%p.length] : 0;
+    assert.equal(host[i], expected, 'byte '+i+' after fill at '+c.offset+'+'+c.size);
+  }
+});
+log('buffer fills ok');
+
+// misuse is rejected before anything is enqueued
+assert.throws(function() { queue.enqueueFillBuffer(buffer, new Uint8Array(3), 0, 12); });
+assert.throws(function() { queue.enqueueFillBuffer(buffer, new Uint32Array(1), 2, 8); });
+assert.throws(function() { queue.enqueueFillBuffer(buffer, new Uint8Array(1), 0, N+1); });
+
+// image fill
+if(device.getInfo(webcl.DEVICE_IMAGE_SUPPORT)) {
+  var W=64, H=32;
+  var image=context.createImage(webcl.MEM_READ_WRITE,
+    { channelOrder: webcl.RGBA, channelType: webcl.UNSIGNED_INT8, width: W, height: H });
+  queue.enqueueFillImage(image, [0,0,0,0], [0,0], [W,H]);
+  queue.enqueueFillImage(image, [10,20,30,40], [8,4], [16,8]);
+  var pixels=new Uint8Array(W*H*4);
+  queue.enqueueReadImage(image, true, [0,0,0], [W,H,1], 0, pixels);
+  for(var y=0;y<H;y++) {
+    for(var x=0;x<W;x++) {
+      var inside=(x>=8 && x<24 && y>=4 && y<12);
+      for(var c=0;c<4;c++)
+        assert.equal(pixels[(y*W+x)*4+c], inside ? (c+1)*10 : 0, 'pixel '+x+','+y);
+    }
+  }
+  log('image fill ok');
+}
+
+// clearing: fill vs. writing a zeroed host array
+var size=MB*1024*1024;
+var big=context.createBuffer(webcl.MEM_READ_WRITE, size);
+var zeros=new Uint8Array(size);
+var ITER=10;
+
+queue.enqueueWriteBuffer(big, true, 0, size, zeros);
+var start=process.hrtime();
+for(var i=0;i<ITER;i++)
+  queue.enqueueWriteBuffer(big, false, 0, size, zeros);
+queue.finish();
+var diff=process.hrtime(start);
+var tWrite=(diff[0]*1e3+diff[1]/1e6)/ITER;
+
+queue.enqueueFillBuffer(big, new Uint32Array(1), 0, size);
+queue.finish();
+start=process.hrtime();
+for(var i=0;i<ITER;i++)
+  queue.enqueueFillBuffer(big, new Uint32Array(1), 0, size);
+queue.finish();
+diff=process.hrtime(start);
+var tFill=(diff[0]*1e3+diff[1]/1e6)/ITER;
+
+log('clear '+MB+' MB: write '+tWrite.toFixed(3)+' ms, fill '+tFill.toFixed(3)+' ms');
+
+webcl.releaseAll();
@@ -0,0 +1,130 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Asynchronous finish: finish(callback) drains the queue on a worker thread,
+// so timers keep firing meanwhile, and passes the clFinish() status to the
+// callback. finishAsync() resolves with that status, or rejects when it is
+// an error.
+//
+// usage: node finish_async.js
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var ITERATIONS = 1<<18;  // loop count in each kernel
+var LAUNCHES   = 32;
+var TICK_MS    = 1;
+
+var kernelSource = [
+"__kernel void spin(__global float *out, uint n)           ",
+"{                                                         ",
+"  size_t i = get_global_id(0);                            ",
+"  float x = (float) i;                                    ",
+"  for(uint k=0; k<n; k++) x = x * 0.999f + 1.0f;          ",
+"  out[i] = x;                                             ",
+"}                                                         "
+].join("\n");
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram(kernelSource);
+program.build(device);
+var kernel=program.createKernel('spin');
+
+var N=1024;
+var out=context.createBuffer(webcl.MEM_WRITE_ONLY, N*Float32Array.BYTES_PER_ELEMENT);
+kernel.setArg(0, out);
+kernel.setArg(1, new Uint32Array([ITERATIONS]));
+
+function enqueueBatch() {
+  var last=new webcl.WebCLEvent();
+  for(var i=0;i<LAUNCHES;i++)
+    queue.enqueueNDRangeKernel(kernel, 1, null, [N], null, null, i==LAUNCHES-1 ? last : null);
+  queue.flush();
+  return last;
+}
+
+// the callback runs later, the loop keeps ticking meanwhile, and the queue
+// is drained when it does
+function testCallback(next) {
+  var last=enqueueBatch();
+  var ticks=0, called=false;
+  var timer=setInterval(function() { ticks++; }, TICK_MS);
+  var start=process.hrtime();
+  queue.finish(function(status) {
+    clearInterval(timer);
+    called=true;
+    var d=process.hrtime(start);
+    assert.strictEqual(status, webcl.SUCCESS);
+    assert.equal(last.getInfo(webcl.EVENT_COMMAND_EXECUTION_STATUS), webcl.COMPLETE);
+    log('finish(callback): '+(d[0]*1e3 + d[1]/1e6).toFixed(2)+' ms, '+ticks+' timer ticks meanwhile');
+    // a device slower than a tick must not have blocked the loop
+    if(d[0]*1e3 + d[1]/1e6 > 20*TICK_MS)
+      assert.ok(ticks>0, 'the event loop was blocked during finish()');
+    next();
+  });
+  assert.ok(!called, 'finish(callback) returned after the callback ran');
+}
+
+function testPromise(next) {
+  if(typeof Promise === 'undefined')
+    return next();
+  enqueueBatch();
+  queue.finishAsync().then(function(status) {
+    assert.strictEqual(status, webcl.SUCCESS);
+
+    // a failed clFinish() rejects, with the status as the error code
+    var failing=Object.create(queue);
+    failing._finish=function(callback) {
+      setTimeout(function() { callback(webcl.OUT_OF_RESOURCES); }, 0);
+    };
+    return failing.finishAsync().then(function() {
+      assert.fail('finishAsync() resolved on an error status');
+    }, function(err) {
+      assert.equal(err.code, webcl.OUT_OF_RESOURCES);
+    });
+  }).then(next, function(err) {
+    log('Error: '+err.stack);
+    process.exit(1);
+  });
+}
+
+testCallback(function() {
+  testPromise(function() {
+    log('finish async ok');
+    webcl.releaseAll();
+  });
+});
@@ -0,0 +1,106 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Auto-flush policies: issues batches of small kernels under several flush
+// policies and reports the time until the last kernel completes, along with
+// how many flushes each policy issued.
+//
+// usage: node flush_policy.js [commands per batch]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var N=4096;
+var COMMANDS=parseInt(process.argv[2]) || 1000;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void inc(__global uint *a, uint n)  ",
+"{                                            ",
+"  size_t i = get_global_id(0);               ",
+"  if(i < n) a[i] += 1;                       ",
+"}                                            "
+].join("\n"));
+program.build(device);
+var kernel=program.createKernel('inc');
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+kernel.setArg(0, buffer);
+kernel.setArg(1, new Uint32Array([N]));
+var host=new Uint32Array(N);
+
+var policies=[
+  { name: 'driver',           policy: {} },
+  { name: 'every 16 cmds',    policy: { commands: 16 } },
+  { name: 'every 256 cmds',   policy: { commands: 256 } },
+  { name: 'every 64 KB',      policy: { bytes: 64*1024 } },
+  { name: '1 ms budget',      policy: { milliseconds: 1 } },
+  { name: 'on wait',          policy: { onWait: true } }
+];
+
+function run(index) {
+  if(index>=policies.length) {
+    webcl.releaseAll();
+    return;
+  }
+  var p=policies[index];
+  queue.setFlushPolicy(p.policy);
+  queue.finish();
+  var before=queue.getFlushStats().autoFlushes;
+
+  var start=process.hrtime();
+  for(var i=0;i<COMMANDS;i++) {
+    if(i%64==0)
+      queue.enqueueWriteBuffer(buffer, false, 0, N*4, host);
+    queue.enqueueNDRangeKernel(kernel, 1, null, [N], null);
+  }
+  var event=new webcl.WebCLEvent();
+  queue.enqueueMarker(event);
+  event.setCallback(webcl.COMPLETE, function() {
+    var diff=process.hrtime(start);
+    var stats=queue.getFlushStats();
+    assert.equal(stats.pendingCommands, 0);
+    log(p.name+': '+(diff[0]*1e3+diff[1]/1e6).toFixed(2)+' ms, '+
+        (stats.autoFlushes-before)+' auto flushes');
+    event.release();
+    run(index+1);
+  });
+  // the driver policy needs an explicit flush to make progress
+  if(!p.policy.onWait && !p.policy.milliseconds)
+    queue.flush();
+}
+
+run(0);
@@ -0,0 +1,145 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Command graphs: a frame of kernels and transfers is recorded once and
+// replayed from native code, with a per-frame scale passed through a
+// parameter slot. Results match issuing the same calls every frame, and the
+// time per frame of both is printed.
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var N=1<<16, FRAMES=1000;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var device=context.getInfo(webcl.CONTEXT_DEVICES)[0];
+var queue=context.createCommandQueue(device);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void scale(__global float *dst, __global const float *src, float s) ",
+"{                                                                            ",
+"  size_t i = get_global_id(0);                                               ",
+"  dst[i] = src[i] * s;                                                       ",
+"}                                                                            ",
+"__kernel void offset(__global float *a, float o)                             ",
+"{                                                                            ",
+"  size_t i = get_global_id(0);                                               ",
+"  a[i] += o;                                                                 ",
+"}                                                                            "
+].join("\n"));
+program.build(device);
+
+var input=new Float32Array(N), output=new Float32Array(N);
+for(var i=0;i<N;i++) input[i]=i;
+var src=context.createBuffer(webcl.MEM_READ_ONLY, N*4);
+var dst=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+var scale=program.createKernel('scale'), offset=program.createKernel('offset');
+
+function frameScale(f) { return new Float32Array([1+(f%7)]); }
+
+function check(f) {
+  var s=1+(f%7);
+  for(var i=0;i<N;i+=997)
+    assert.equal(output[i], i*s+0.5, 'frame '+f+' element '+i);
+}
+
+// recorded frame, the scale comes from parameter slot 0
+var rec=queue.beginRecording();
+queue.enqueueWriteBuffer(src, false, 0, N*4, input);
+rec.setArg(scale, 0, dst);
+rec.setArg(scale, 1, src);
+rec.setArg(scale, 2, webcl.graphParam(0));
+queue.enqueueNDRangeKernel(scale, 1, null, [N], null);
+rec.setArg(offset, 0, dst);
+rec.setArg(offset, 1, new Float32Array([0.5]));
+queue.enqueueNDRangeKernel(offset, 1, null, [N], null);
+queue.enqueueReadBuffer(dst, false, 0, N*4, output);
+var graph=queue.endRecording();
+
+// kernel.setArg() and launches on other queues are not affected by a
+// recording in progress
+var other=context.createCommandQueue(device);
+queue.beginRecording();
+var probe=new Float32Array(N);
+scale.setArg(0, dst);
+scale.setArg(1, src);
+scale.setArg(2, new Float32Array([3]));
+other.enqueueWriteBuffer(src, false, 0, N*4, input);
+other.enqueueNDRangeKernel(scale, 1, null, [N], null);
+other.enqueueReadBuffer(dst, true, 0, N*4, probe);
+for(var i=0;i<N;i+=997)
+  assert.equal(probe[i], i*3, 'element '+i+' on another queue');
+
+// other commands are refused while recording
+assert.throws(function () { queue.enqueueFillBuffer(dst, new Uint8Array(4), 0, 4); });
+queue.endRecording().release();
+
+graph.replay([frameScale(3)]);
+queue.finish();
+check(3);
+
+// a missing parameter keeps the previous value
+output.fill(0);
+graph.replay();
+queue.finish();
+check(3);
+log('replay ok');
+
+var start=process.hrtime();
+for(var f=0;f<FRAMES;f++)
+  graph.replay([frameScale(f)]);
+queue.finish();
+var diff=process.hrtime(start);
+check(FRAMES-1);
+log('replayed graph:  '+((diff[0]*1e3+diff[1]/1e6)/FRAMES*1e3).toFixed(1)+' us/frame');
+
+start=process.hrtime();
+for(var f=0;f<FRAMES;f++) {
+  queue.enqueueWriteBuffer(src, false, 0, N*4, input);
+  scale.setArg(0, dst);
+  scale.setArg(1, src);
+  scale.setArg(2, frameScale(f));
+  queue.enqueueNDRangeKernel(scale, 1, null, [N], null);
+  offset.setArg(0, dst);
+  offset.setArg(1, new Float32Array([0.5]));
+  queue.enqueueNDRangeKernel(offset, 1, null, [N], null);
+  queue.enqueueReadBuffer(dst, false, 0, N*4, output);
+}
+queue.finish();
+diff=process.hrtime(start);
+check(FRAMES-1);
+log('individual calls: '+((diff[0]*1e3+diff[1]/1e6)/FRAMES*1e3).toFixed(1)+' us/frame');
+
+graph.release();
+webcl.releaseAll();
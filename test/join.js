@@ -0,0 +1,125 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Join points: markers and barriers that wait on an event list and hand
+// back an event. Two queues produce halves of a buffer, a marker on a third
+// queue joins them and a kernel chained on the marker's event sums both
+// halves without any wait on the host.
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var N=1<<20;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var device=context.getInfo(webcl.CONTEXT_DEVICES)[0];
+var q1=context.createCommandQueue(device);
+var q2=context.createCommandQueue(device);
+var q3=context.createCommandQueue(device);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void produce(__global uint *a, uint base)       ",
+"{                                                        ",
+"  size_t i = get_global_id(0);                           ",
+"  a[i] = base + 1;                                       ",
+"}                                                        ",
+"__kernel void combine(__global uint *a, uint half_n)     ",
+"{                                                        ",
+"  size_t i = get_global_id(0);                           ",
+"  a[i] += a[i + half_n];                                 ",
+"}                                                        "
+].join("\n"));
+program.build(device);
+
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+var lo=buffer.createSubBuffer(webcl.MEM_READ_WRITE, 0, N*2);
+var hi=buffer.createSubBuffer(webcl.MEM_READ_WRITE, N*2, N*2);
+
+var k1=program.createKernel('produce'), k2=program.createKernel('produce');
+k1.setArg(0, lo); k1.setArg(1, new Uint32Array([0]));
+k2.setArg(0, hi); k2.setArg(1, new Uint32Array([1]));
+var e1=new webcl.WebCLEvent(), e2=new webcl.WebCLEvent();
+q1.enqueueNDRangeKernel(k1, 1, null, [N/2], null, null, e1);
+q2.enqueueNDRangeKernel(k2, 1, null, [N/2], null, null, e2);
+
+// the marker's event is a real one and can be chained on
+var joined=new webcl.WebCLEvent();
+q3.enqueueMarker([e1, e2], joined);
+var combine=program.createKernel('combine');
+combine.setArg(0, buffer);
+combine.setArg(1, new Uint32Array([N/2]));
+var done=new webcl.WebCLEvent();
+q3.enqueueNDRangeKernel(combine, 1, null, [N/2], null, [joined], done);
+q1.flush();
+q2.flush();
+
+var host=new Uint32Array(N/2);
+q3.enqueueReadBuffer(buffer, true, 0, N*2, host, [done]);
+for(var i=0;i<N/2;i++)
+  assert.equal(host[i], 3, 'element '+i);
+assert.equal(joined.getInfo(webcl.EVENT_COMMAND_EXECUTION_STATUS), webcl.COMPLETE);
+log('marker join ok');
+
+// barrier with a wait list also returns an event
+var barrier=new webcl.WebCLEvent();
+q1.enqueueNDRangeKernel(k1, 1, null, [N/2], null, null, e1);
+q2.enqueueBarrier([e1], barrier);
+q1.flush();
+webcl.waitForEvents([barrier]);
+assert.equal(e1.getInfo(webcl.EVENT_COMMAND_EXECUTION_STATUS), webcl.COMPLETE);
+log('barrier join ok');
+
+// cost of a join point: marker on an event list vs. waiting on the host
+var ITER=1000;
+var start=process.hrtime();
+for(var i=0;i<ITER;i++) {
+  q1.enqueueNDRangeKernel(k1, 1, null, [64], null, null, e1);
+  q2.enqueueMarker([e1], e2);
+}
+q1.finish();
+q2.finish();
+var diff=process.hrtime(start);
+log('device-side join: '+((diff[0]*1e3+diff[1]/1e6)/ITER*1e3).toFixed(1)+' us');
+
+start=process.hrtime();
+for(var i=0;i<ITER;i++) {
+  q1.enqueueNDRangeKernel(k1, 1, null, [64], null, null, e1);
+  webcl.waitForEvents([e1]);
+  q2.enqueueMarker(e2);
+}
+q2.finish();
+diff=process.hrtime(start);
+log('host-side join:   '+((diff[0]*1e3+diff[1]/1e6)/ITER*1e3).toFixed(1)+' us');
+
+webcl.releaseAll();
@@ -0,0 +1,96 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Host-side cost of enqueueNDRangeKernel for 1D/2D/3D launches, with work
+// sizes given as JS arrays, Uint32Array and Float64Array. Typed arrays are
+// read in place by the binding, so they should be the cheapest form.
+//
+//   node test/launch_overhead.js [cpu|gpu|all] [iterations]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var deviceTypes = {
+  cpu: webcl.DEVICE_TYPE_CPU,
+  gpu: webcl.DEVICE_TYPE_GPU,
+  all: webcl.DEVICE_TYPE_ALL
+};
+var deviceType = deviceTypes[process.argv[2] || 'cpu'] || webcl.DEVICE_TYPE_CPU;
+var ITERATIONS = parseInt(process.argv[3] || '20000', 10);
+var BATCH      = 1000;   // launches between two finish()
+
+var context=webcl.createContext(deviceType);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram("__kernel void nop(__global int *a) { }");
+program.build(device);
+var kernel=program.createKernel('nop');
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, 64);
+kernel.setArg(0, buffer);
+
+function bench(name, fn) {
+  var elapsed=0;
+  for(var done=0; done<ITERATIONS; done+=BATCH) {
+    var start=process.hrtime();
+    for(var i=0;i<BATCH;i++)
+      fn();
+    var d=process.hrtime(start);
+    elapsed+=d[0]*1e9 + d[1];
+    queue.finish();
+  }
+  log('  '+name+': '+(elapsed/ITERATIONS/1e3).toFixed(3)+' us/launch');
+}
+
+var shapes = [
+  { dim: 1, globals: [64],       locals: [8] },
+  { dim: 2, globals: [8, 8],     locals: [4, 2] },
+  { dim: 3, globals: [4, 4, 4],  locals: [2, 2, 2] },
+];
+
+log('Launch overhead over '+ITERATIONS+' launches');
+shapes.forEach(function(s) {
+  var forms = {
+    'Array':        [ s.globals, s.locals ],
+    'Uint32Array':  [ new Uint32Array(s.globals), new Uint32Array(s.locals) ],
+    'Float64Array': [ new Float64Array(s.globals), new Float64Array(s.locals) ],
+  };
+  for(var name in forms) {
+    var g=forms[name][0], l=forms[name][1];
+    queue.enqueueNDRangeKernel(kernel, s.dim, null, g, l); // warm up
+    bench(s.dim+'D '+name, function() {
+      queue.enqueueNDRangeKernel(kernel, s.dim, null, g, l);
+    });
+  }
+});
+
+webcl.releaseAll();
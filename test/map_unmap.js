@@ -0,0 +1,161 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Mapped regions: a mapped buffer is shared with the device without copies,
+// unmapping detaches the view, unmapping twice is an error, and releasing a
+// buffer unmaps whatever is still mapped, and so does collecting a view.
+// Mapped images report their pitch.
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var N=1024*1024;
+var size=N*Uint32Array.BYTES_PER_ELEMENT;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE | webcl.MEM_ALLOC_HOST_PTR, size);
+
+// write through a mapped view, read back with a copy
+var view=queue.enqueueMapBuffer(buffer, true, webcl.MAP_WRITE, 0, size);
+assert.equal(view.length, size);
+for(var i=0;i<size;i++) view[i]=i & 0xff;
+queue.enqueueUnmapMemObject(buffer, view);
+
+// the view is detached: reads see nothing and writes go nowhere
+assert.equal(view[0], undefined);
+view[1]=42;
+assert.equal(view[1], undefined);
+
+var check=new Uint8Array(size);
+queue.enqueueReadBuffer(buffer, true, 0, size, check);
+assert.equal(check[1], 1);
+assert.equal(check[size-1], (size-1) & 0xff);
+
+// a second unmap of the same view is rejected
+assert.throws(function() {
+  queue.enqueueUnmapMemObject(buffer, view);
+}, function(ex) { return ex.name === 'INVALID_VALUE'; });
+
+// so is a Buffer that was never mapped
+assert.throws(function() {
+  queue.enqueueUnmapMemObject(buffer, new Buffer(16));
+}, function(ex) { return ex.name === 'INVALID_VALUE'; });
+
+// each map call has its own view, even for the same range: unmapping one
+// leaves the other usable
+var first=queue.enqueueMapBuffer(buffer, true, webcl.MAP_READ, 0, 16);
+var second=queue.enqueueMapBuffer(buffer, true, webcl.MAP_READ, 0, 16);
+queue.enqueueUnmapMemObject(buffer, first);
+assert.equal(first[1], undefined);
+assert.equal(second[1], 1);
+
+// a view is unmapped on the queue that mapped it
+var queue2=context.createCommandQueue();
+assert.throws(function() {
+  queue2.enqueueUnmapMemObject(buffer, second);
+}, function(ex) { return ex.name === 'INVALID_VALUE'; });
+queue.enqueueUnmapMemObject(buffer, second);
+
+// releasing a buffer unmaps its regions and detaches their views
+var other=context.createBuffer(webcl.MEM_READ_WRITE | webcl.MEM_ALLOC_HOST_PTR, size);
+var leaked=queue.enqueueMapBuffer(other, true, webcl.MAP_READ, 0, size);
+other.release();
+assert.equal(leaked[0], undefined);
+
+// mapped images expose their pitch, and the view covers every pitched row
+var W=67, H=33;
+var image=context.createImage(webcl.MEM_READ_WRITE | webcl.MEM_ALLOC_HOST_PTR, {
+  channelOrder : webcl.RGBA,
+  channelType : webcl.FLOAT,
+  width : W,
+  height : H
+});
+var tile=queue.enqueueMapImage(image, true, webcl.MAP_WRITE, [0,0], [W,H]);
+assert.equal(tile.elementSize, 16);
+assert(tile.rowPitch >= W*tile.elementSize);
+assert.equal(tile.length, (H-1)*tile.rowPitch + W*tile.elementSize);
+for(var y=0;y<H;y++)
+  tile.writeFloatLE(y, y*tile.rowPitch + (W-1)*tile.elementSize);
+queue.enqueueUnmapMemObject(image, tile);
+
+var pixels=new Float32Array(W*H*4);
+queue.enqueueReadImage(image, true, [0,0], [W,H], 0, pixels);
+assert.equal(pixels[((H-1)*W + W-1)*4], H-1);
+
+// map/unmap round trips versus read/write copies
+var ITERATIONS=100;
+var host=new Uint8Array(size);
+
+var start=process.hrtime();
+for(var i=0;i<ITERATIONS;i++) {
+  var v=queue.enqueueMapBuffer(buffer, true, webcl.MAP_READ | webcl.MAP_WRITE, 0, size);
+  v[0]++;
+  queue.enqueueUnmapMemObject(buffer, v);
+}
+queue.finish();
+var diff=process.hrtime(start);
+log('map/unmap:  '+((diff[0]*1e3+diff[1]/1e6)/ITERATIONS).toFixed(3)+' ms per round trip');
+
+start=process.hrtime();
+for(var i=0;i<ITERATIONS;i++) {
+  queue.enqueueReadBuffer(buffer, true, 0, size, host);
+  host[0]++;
+  queue.enqueueWriteBuffer(buffer, false, 0, size, host);
+}
+queue.finish();
+diff=process.hrtime(start);
+log('read/write: '+((diff[0]*1e3+diff[1]/1e6)/ITERATIONS).toFixed(3)+' ms per round trip');
+
+// a view that is collected while mapped is unmapped on the next loop turn,
+// which makes its writes visible (run with --expose-gc)
+if(typeof gc === 'function') {
+  (function() {
+    var v=queue.enqueueMapBuffer(buffer, true, webcl.MAP_WRITE, 0, 16);
+    for(var i=0;i<16;i++) v[i]=0xa0+i;
+  })();
+  gc();
+  setTimeout(function() {
+    queue.finish();
+    var bytes=new Uint8Array(16);
+    queue.enqueueReadBuffer(buffer, true, 0, 16, bytes);
+    assert.equal(bytes[15], 0xaf);
+    log('collected view unmapped');
+    webcl.releaseAll();
+  }, 10);
+}
+else
+  webcl.releaseAll();
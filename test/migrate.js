@@ -0,0 +1,123 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Memory migration in a multi-device context: a kernel on the first device
+// produces a buffer that a kernel on the last device consumes. Times the
+// consumer with and without a residency hint on the buffer, the hint moves
+// the data while the producer's queue is being waited on instead of inside
+// the consumer launch. With a single device both queues share it.
+//
+// usage: node migrate.js [MB]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var MB=parseInt(process.argv[2]) || 64;
+var N=MB*1024*1024/4;
+
+var platform=webcl.getPlatforms()[0];
+var devices=platform.getDevices(webcl.DEVICE_TYPE_ALL);
+var context=webcl.createContext(devices);
+var producer=context.createCommandQueue(devices[0]);
+var consumer=context.createCommandQueue(devices[devices.length-1]);
+log('using device: '+devices[0].getInfo(webcl.DEVICE_NAME)+' -> '+
+    devices[devices.length-1].getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void produce(__global uint *a, uint seed)    ",
+"{                                                     ",
+"  size_t i = get_global_id(0);                        ",
+"  a[i] = i ^ seed;                                    ",
+"}                                                     ",
+"__kernel void consume(__global uint *a, __global uint *sum) ",
+"{                                                     ",
+"  size_t i = get_global_id(0);                        ",
+"  if(a[i] == 0) atomic_inc(sum);                      ",
+"}                                                     "
+].join("\n"));
+program.build(devices);
+var produce=program.createKernel('produce');
+var consume=program.createKernel('consume');
+
+function elapsed(start) {
+  var diff=process.hrtime(start);
+  return diff[0]*1e3+diff[1]/1e6;
+}
+
+function run(hint) {
+  var data=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+  var sum=context.createBuffer(webcl.MEM_READ_WRITE, 4);
+  consumer.enqueueFillBuffer(sum, new Uint32Array(1), 0, 4);
+  if(hint) data.setPreferredDevice(consumer);
+
+  produce.setArg(0, data);
+  produce.setArg(1, new Uint32Array([7]));
+  consume.setArg(0, data);
+  consume.setArg(1, sum);
+
+  producer.enqueueNDRangeKernel(produce, 1, null, [N], null);
+  producer.finish();
+  consumer.finish();
+
+  var start=process.hrtime();
+  consumer.enqueueNDRangeKernel(consume, 1, null, [N], null);
+  consumer.finish();
+  var t=elapsed(start);
+
+  // exactly one element is i^7 == 0
+  var host=new Uint32Array(1);
+  consumer.enqueueReadBuffer(sum, true, 0, 4, host);
+  assert.equal(host[0], 1);
+
+  data.setPreferredDevice(null);
+  data.release();
+  sum.release();
+  return t;
+}
+
+run(false);
+log('consumer launch without hint: '+run(false).toFixed(3)+' ms');
+log('consumer launch with hint:    '+run(true).toFixed(3)+' ms');
+
+// explicit migrations, including to the host and without content
+var scratch=context.createBuffer(webcl.MEM_READ_WRITE, 4096);
+var ev=new webcl.WebCLEvent();
+consumer.enqueueMigrateMemObjects([scratch], webcl.MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED, null, ev);
+producer.enqueueMigrateMemObjects([scratch], 0, [ev]);
+producer.enqueueMigrateMemObjects([scratch], webcl.MIGRATE_MEM_OBJECT_HOST);
+producer.finish();
+assert.throws(function() { producer.enqueueMigrateMemObjects([], 0); });
+assert.throws(function() { producer.enqueueMigrateMemObjects([scratch], 0x100); });
+log('explicit migrations ok');
+
+webcl.releaseAll();
@@ -0,0 +1,128 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Fan-in of many events: 1000 small kernels, each with its own WebCLEvent,
+// are waited on with a setCallback per event, with one webcl.onComplete()
+// for all of them, and with onComplete() in 1 ms batches. Reports the time
+// until the last completion is seen in JS and the number of JS callbacks.
+//
+// usage: node on_complete.js [events]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var EVENTS=parseInt(process.argv[2]) || 1000;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void inc(__global uint *a)  ",
+"{                                    ",
+"  a[get_global_id(0)] += 1;          ",
+"}                                    "
+].join("\n"));
+program.build(device);
+var kernel=program.createKernel('inc');
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, 64*4);
+kernel.setArg(0, buffer);
+
+function launch() {
+  var events=[];
+  for(var i=0;i<EVENTS;i++) {
+    var ev=new webcl.WebCLEvent();
+    queue.enqueueNDRangeKernel(kernel, 1, null, [64], null, null, ev);
+    events.push(ev);
+  }
+  queue.flush();
+  return events;
+}
+
+function report(name, start, calls) {
+  var diff=process.hrtime(start);
+  log(name+': '+(diff[0]*1e3+diff[1]/1e6).toFixed(2)+' ms, '+calls+' JS callbacks');
+}
+
+function perEvent(next) {
+  var start=process.hrtime(), events=launch(), left=EVENTS, calls=0;
+  events.forEach(function(ev) {
+    ev.setCallback(webcl.COMPLETE, function() {
+      calls++;
+      if(--left==0) {
+        report('setCallback per event', start, calls);
+        next();
+      }
+    });
+  });
+}
+
+function all(next) {
+  var start=process.hrtime(), events=launch(), calls=0;
+  webcl.onComplete(events, function(status) {
+    calls++;
+    assert.equal(status, webcl.COMPLETE);
+    events.forEach(function(ev) { assert.equal(ev.status, webcl.COMPLETE); });
+    report('onComplete, all', start, calls);
+    next();
+  });
+}
+
+function batched(next) {
+  var start=process.hrtime(), events=launch(), calls=0;
+  var seen=new Uint8Array(EVENTS), count=0;
+  webcl.onComplete(events, function(indices, statuses, done) {
+    calls++;
+    assert.equal(indices.length, statuses.length);
+    for(var i=0;i<indices.length;i++) {
+      assert.equal(seen[indices[i]], 0, 'index '+indices[i]+' reported twice');
+      assert.equal(statuses[i], webcl.COMPLETE);
+      seen[indices[i]]=1;
+      count++;
+    }
+    if(done) {
+      assert.equal(count, EVENTS);
+      report('onComplete, 1 ms batches', start, calls);
+      next();
+    }
+  }, { batchMilliseconds: 1 });
+}
+
+perEvent(function() {
+  all(function() {
+    batched(function() {
+      webcl.releaseAll();
+    });
+  });
+});
@@ -0,0 +1,139 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Streams a device buffer into a file with WebCLBufferReadStream for several
+// chunk sizes and depths, copied or mapped, checks the file contents and
+// reports throughput. Then pipes small chunks into a slow destination that
+// queues them, and checks the queued bytes.
+//
+// usage: node readback_stream.js [size in MB]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert'),
+    stream=require('stream'),
+    fs=require('fs'),
+    os=require('os'),
+    path=require('path');
+
+var SIZE=(parseInt(process.argv[2]) || 256)*1024*1024;
+var file=path.join(os.tmpdir(), 'webcl_readback_stream.bin');
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+// byte i of the buffer is (i*13) & 0xff
+var block=new Buffer(1024*1024);
+for(var i=0;i<block.length;i++) block[i]=(i*13) & 0xff;
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, SIZE);
+for(var off=0;off<SIZE;off+=block.length)
+  queue.enqueueWriteBuffer(buffer, false, off, Math.min(block.length, SIZE-off), block);
+queue.finish();
+
+var configs=[
+  { chunkSize: 1024*1024,   depth: 1 },
+  { chunkSize: 1024*1024,   depth: 2 },
+  { chunkSize: 4*1024*1024, depth: 2 },
+  { chunkSize: 4*1024*1024, depth: 3 },
+  { chunkSize: 4*1024*1024, depth: 3, map: true }
+];
+
+// small chunks piped into a slow destination with a large highWaterMark:
+// write() keeps returning true while the chunks pile up in its queue, so
+// they must not share memory with the reads that follow
+function runQueued(map, next) {
+  var SMALL=4096, LENGTH=256*SMALL;
+  var source=new webcl.WebCLBufferReadStream(queue, buffer, { chunkSize: SMALL, depth: 2, length: LENGTH, map: map });
+  var sink=new stream.Writable({ highWaterMark: 64*1024*1024 });
+  var chunks=[];
+  sink._write=function(chunk, encoding, callback) {
+    chunks.push(chunk);
+    setTimeout(callback, 1);
+  };
+  source.on('error', function(err) {
+    log('readback failed: '+err);
+    process.exit(-1);
+  });
+  sink.on('finish', function() {
+    var all=Buffer.concat(chunks);
+    assert.equal(all.length, LENGTH);
+    for(var i=0;i<LENGTH;i++)
+      assert.equal(all[i], (i*13) & 0xff, 'queued byte '+i);
+    log('queued small chunks'+(map ? ', mapped' : '')+': ok');
+    next();
+  });
+  source.pipe(sink);
+}
+
+function run(index) {
+  if(index>=configs.length) {
+    fs.unlinkSync(file);
+    runQueued(false, function() {
+      runQueued(true, function() {
+        webcl.releaseAll();
+      });
+    });
+    return;
+  }
+
+  var config=configs[index];
+  var source=new webcl.WebCLBufferReadStream(queue, buffer, config);
+  var sink=fs.createWriteStream(file);
+  source.on('error', function(err) {
+    log('readback failed: '+err);
+    process.exit(-1);
+  });
+  sink.on('finish', function() {
+    var stats=source.stats();
+    assert.equal(stats.bytes, SIZE);
+    assert.equal(fs.statSync(file).size, SIZE);
+
+    // staging slots are reused, every part of the file must still be right
+    var part=new Buffer(1024*1024);
+    var fd=fs.openSync(file, 'r');
+    for(var off=0;off<SIZE;off+=part.length) {
+      var n=fs.readSync(fd, part, 0, Math.min(part.length, SIZE-off), off);
+      for(var i=0;i<n;i+=997)
+        assert.equal(part[i], ((off+i)*13) & 0xff, 'byte '+(off+i));
+    }
+    fs.closeSync(fd);
+
+    log('chunk '+(config.chunkSize>>20)+' MB, depth '+config.depth+(config.map ? ', mapped' : '')+': '+
+        stats.throughput.toFixed(1)+' MB/s');
+    run(index+1);
+  });
+  source.pipe(sink);
+}
+
+run(0);
@@ -0,0 +1,125 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Scatter/gather transfers: updates hundreds of small, scattered ranges of a
+// large buffer per frame, once with one enqueueWriteBuffer per range and once
+// with a single enqueueWriteBufferScatter, then reads them back with
+// enqueueReadBufferGather and checks the contents.
+//
+// usage: node scatter_gather.js [ranges per frame] [frames]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var RANGES=parseInt(process.argv[2]) || 500;
+var FRAMES=parseInt(process.argv[3]) || 50;
+var SIZE=64*1024*1024;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, SIZE);
+queue.enqueueFillBuffer(buffer, new Uint8Array(1), 0, SIZE);
+
+// random small ranges, a few of them adjacent so they merge, plus one large
+// range that is transferred on its own
+function makeRanges(seed) {
+  var ranges=[], hostOffset=0, deviceOffset=0;
+  var stride=Math.floor(SIZE/(RANGES+1));
+  for(var i=0;i<RANGES;i++) {
+    var length=16+((seed*31+i*7)%240);
+    deviceOffset=(i%10===9) ? deviceOffset : i*stride;
+    ranges.push(deviceOffset, hostOffset, length);
+    deviceOffset+=length;
+    hostOffset+=length;
+  }
+  ranges.push(RANGES*stride, hostOffset, stride);
+  hostOffset+=stride;
+  return { list: new Float64Array(ranges), bytes: hostOffset };
+}
+
+function elapsed(start) {
+  var diff=process.hrtime(start);
+  return diff[0]*1e3+diff[1]/1e6;
+}
+
+var r=makeRanges(1);
+var host=new Uint8Array(r.bytes);
+for(var i=0;i<host.length;i++)
+  host[i]=(i*13+5)&0xff;
+
+queue.finish();
+var start=process.hrtime();
+for(var f=0;f<FRAMES;f++) {
+  for(var i=0;i<r.list.length;i+=3)
+    queue.enqueueWriteBuffer(buffer, false, r.list[i], r.list[i+2],
+      host.subarray(r.list[i+1], r.list[i+1]+r.list[i+2]));
+  queue.finish();
+}
+log('per-range writes: '+(elapsed(start)/FRAMES).toFixed(3)+' ms/frame');
+
+start=process.hrtime();
+for(var f=0;f<FRAMES;f++) {
+  queue.enqueueWriteBufferScatter(buffer, false, r.list, host);
+  queue.finish();
+}
+log('scatter write:    '+(elapsed(start)/FRAMES).toFixed(3)+' ms/frame');
+
+// read everything back, blocking and through an event
+var back=new Uint8Array(r.bytes);
+queue.enqueueReadBufferGather(buffer, true, r.list, back);
+for(var i=0;i<back.length;i++)
+  assert.equal(back[i], host[i], 'byte '+i);
+
+var back2=new Uint8Array(r.bytes);
+var ev=new webcl.WebCLEvent();
+queue.enqueueReadBufferGather(buffer, false, r.list, back2, null, ev);
+webcl.waitForEvents([ev]);
+for(var i=0;i<back2.length;i++)
+  assert.equal(back2[i], host[i], 'byte '+i);
+log('gather ok');
+
+// overlapping writes and out of range triples are rejected
+assert.throws(function() {
+  queue.enqueueWriteBufferScatter(buffer, true, new Uint32Array([0,0,8, 4,8,8]), host);
+});
+assert.throws(function() {
+  queue.enqueueWriteBufferScatter(buffer, true, new Uint32Array([SIZE-4,0,8]), host);
+});
+assert.throws(function() {
+  queue.enqueueWriteBufferScatter(buffer, true, new Uint32Array([0,0]), host);
+});
+
+webcl.releaseAll();
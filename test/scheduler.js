@@ -0,0 +1,124 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Submits many independent jobs of two sizes through WebCLScheduler with
+// each policy, over one queue per device plus a second queue on the first
+// device, and compares the makespan with plain round-robin.
+//
+// usage: node scheduler.js [jobs]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var JOBS=parseInt(process.argv[2]) || 400;
+var N=64*1024;
+
+var platform=webcl.getPlatforms()[0];
+var devices=platform.getDevices(webcl.DEVICE_TYPE_ALL);
+var context=webcl.createContext(devices);
+var queues=devices.map(function(device) {
+  log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+  return context.createCommandQueue(device);
+});
+queues.push(context.createCommandQueue(devices[0]));
+
+var program=context.createProgram([
+"__kernel void work(__global float *a, uint iterations)           ",
+"{                                                                ",
+"  size_t i = get_global_id(0);                                   ",
+"  float v = a[i];                                                ",
+"  for(uint k = 0; k < iterations; k++) v = v * 0.999f + 0.001f;  ",
+"  a[i] = v;                                                      ",
+"}                                                                "
+].join("\n"));
+program.build(devices);
+
+// one kernel and buffer per queue so jobs on different queues are independent
+var lanes=queues.map(function(queue) {
+  var kernel=program.createKernel('work');
+  var buffer=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+  kernel.setArg(0, buffer);
+  return { kernel: kernel, buffer: buffer };
+});
+
+function job(iterations) {
+  return function(queue) {
+    var lane=lanes[queues.indexOf(queue)];
+    lane.kernel.setArg(1, new Uint32Array([iterations]));
+    var event=new webcl.WebCLEvent();
+    queue.enqueueNDRangeKernel(lane.kernel, 1, null, [N], null, null, event);
+    return event;
+  };
+}
+
+// a fake scheduler with the same interface that ignores load
+function RoundRobin(queues) {
+  this.queues=queues;
+  this.next=0;
+}
+RoundRobin.prototype.submit=function(fn, options, callback) {
+  var queue=this.queues[this.next++ % this.queues.length];
+  var event=fn(queue);
+  event.setCallback(webcl.COMPLETE, function() { callback(null, queue); });
+  queue.flush();
+};
+
+var runs=[
+  { name: 'round-robin',  make: function() { return new RoundRobin(queues); } },
+  { name: 'least-loaded', make: function() { return new webcl.WebCLScheduler(queues); } },
+  { name: 'eta',          make: function() { return new webcl.WebCLScheduler(queues, { policy: 'eta' }); } }
+];
+
+function run(index) {
+  if(index>=runs.length) {
+    webcl.releaseAll();
+    return;
+  }
+  var scheduler=runs[index].make(), done=0;
+  var perQueue=queues.map(function() { return 0; });
+  var start=process.hrtime();
+  for(var i=0;i<JOBS;i++) {
+    var big=(i%4==0);
+    scheduler.submit(job(big ? 2000 : 200), { kind: big ? 'big' : 'small' }, function(err, queue) {
+      assert.ifError(err);
+      perQueue[queues.indexOf(queue)]++;
+      if(++done==JOBS) {
+        var diff=process.hrtime(start);
+        log(runs[index].name+': '+(diff[0]*1e3+diff[1]/1e6).toFixed(1)+' ms, jobs per queue '+perQueue.join(' '));
+        run(index+1);
+      }
+    });
+  }
+}
+
+run(0);
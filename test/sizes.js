@@ -0,0 +1,140 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Sizes and offsets: buffer APIs take any integer up to 2^53 or a BigInt,
+// reject NaN, fractional, negative and out-of-range values instead of
+// truncating them, and rectangle checks don't wrap around at 4 GiB.
+//
+// usage: node sizes.js
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var GiB=1024*1024*1024;
+var SIZE=1<<20;
+
+function throwsCL(name, fn) {
+  assert.throws(fn, function(ex) { return ex.name === name; }, 'expected '+name);
+}
+
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, SIZE);
+var host=new Uint8Array(SIZE);
+
+// NaN, fractional and negative sizes and offsets are rejected
+[NaN, 0.5, SIZE+0.5, -1, -SIZE, Infinity].forEach(function(bad) {
+  throwsCL('INVALID_VALUE', function() { context.createBuffer(webcl.MEM_READ_WRITE, bad); });
+  throwsCL('INVALID_VALUE', function() { queue.enqueueReadBuffer(buffer, true, bad, 16, host); });
+  throwsCL('INVALID_VALUE', function() { queue.enqueueReadBuffer(buffer, true, 0, bad, host); });
+  throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, bad, 16); });
+  throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, 0, bad); });
+});
+
+// sizes above 2^53 can't be represented exactly
+throwsCL('INVALID_VALUE', function() { context.createBuffer(webcl.MEM_READ_WRITE, Math.pow(2, 54)); });
+
+// sub-buffers must lie within their parent, also past 4 GiB where a 32-bit
+// origin would have wrapped to 0
+throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, 0, SIZE+1); });
+throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, SIZE, 1); });
+throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, 4*GiB, 16); });
+throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, 0, 4*GiB+16); });
+throwsCL('INVALID_VALUE', function() { buffer.createSubBuffer(webcl.MEM_READ_WRITE, 0, 0); });
+var sub=buffer.createSubBuffer(webcl.MEM_READ_WRITE, 0, SIZE/2);
+assert.equal(sub.getInfo(webcl.MEM_SIZE), SIZE/2);
+
+// a transfer 4 GiB past the buffer must not wrap into it
+throwsCL('INVALID_VALUE', function() { queue.enqueueReadBuffer(buffer, true, 4*GiB, 16, host); });
+
+// a rectangle of 8 GiB is larger than the host array, not 0 bytes
+throwsCL('INVALID_VALUE', function() {
+  queue.enqueueReadBufferRect(buffer, true, [0,0,0], [0,0,0], [65536,65536,2], 0, 0, 0, 0, host);
+});
+
+// so is an image region larger than the image and the host array
+if(device.getInfo(webcl.DEVICE_IMAGE_SUPPORT)) {
+  var image=context.createImage(webcl.MEM_READ_WRITE, {
+    channelOrder : webcl.RGBA,
+    channelType : webcl.UNSIGNED_INT8,
+    width : 64,
+    height : 64
+  });
+  throwsCL('INVALID_VALUE', function() {
+    queue.enqueueReadImage(image, true, [0,0], [65536,65536], 0, host);
+  });
+}
+
+// BigInt sizes, where the runtime has them
+if(typeof BigInt === 'function') {
+  var big=context.createBuffer(webcl.MEM_READ_WRITE, BigInt(SIZE));
+  assert.equal(big.getInfo(webcl.MEM_SIZE), SIZE);
+  queue.enqueueWriteBuffer(big, true, BigInt(16), BigInt(16), host);
+  assert.throws(function() {
+    context.createBuffer(webcl.MEM_READ_WRITE, BigInt(Number.MAX_SAFE_INTEGER)+BigInt(2));
+  }, RangeError);
+  assert.throws(function() {
+    queue.enqueueReadBuffer(big, true, BigInt(-1), BigInt(16), host);
+  }, RangeError);
+}
+
+// a buffer above 4 GiB keeps its size, or is refused if the device can't
+// allocate it
+var LARGE=4*GiB+4096;
+var maxAlloc=device.getInfo(webcl.DEVICE_MAX_MEM_ALLOC_SIZE);
+if(maxAlloc>=LARGE) {
+  var large=context.createBuffer(webcl.MEM_READ_WRITE, LARGE);
+  assert.equal(large.getInfo(webcl.MEM_SIZE), LARGE);
+  // the same 16 bytes 4 GiB apart: a wrapped offset would overwrite the zeros
+  var check=new Uint8Array(16);
+  queue.enqueueWriteBuffer(large, true, 4096-16, 16, check);
+  var tail=new Uint8Array(16);
+  for(var i=0;i<16;i++) tail[i]=i+1;
+  queue.enqueueWriteBuffer(large, true, LARGE-16, 16, tail);
+  queue.enqueueReadBuffer(large, true, LARGE-16, 16, check);
+  assert.equal(check[15], 16);
+  queue.enqueueReadBuffer(large, true, 4096-16, 16, check);
+  assert.equal(check[15], 0);
+  large.release();
+  log('4 GiB+ buffer ok');
+}
+else {
+  throwsCL('INVALID_BUFFER_SIZE', function() { context.createBuffer(webcl.MEM_READ_WRITE, LARGE); });
+  log('device allocates at most '+maxAlloc+' bytes, skipped the 4 GiB+ buffer');
+}
+
+log('sizes ok');
+webcl.releaseAll();
@@ -0,0 +1,111 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Host<->device bandwidth of plain enqueueWriteBuffer/enqueueReadBuffer
+// against the same calls routed through the context's pinned staging pool.
+//
+// usage: node staging_pool.js [iterations]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var ITERATIONS=parseInt(process.argv[2]) || 20;
+var SIZES=[256*1024, 4*1024*1024, 32*1024*1024];
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+function bandwidth(fn, size) {
+  fn(); // warm up, allocates pool buffers
+  queue.finish();
+  var start=process.hrtime();
+  for(var i=0;i<ITERATIONS;i++)
+    fn();
+  queue.finish();
+  var diff=process.hrtime(start);
+  return (size*ITERATIONS/(diff[0]+diff[1]/1e9)/1e6).toFixed(1)+' MB/s';
+}
+
+SIZES.forEach(function(size) {
+  var host=new Uint8Array(size), back=new Uint8Array(size);
+  for(var i=0;i<size;i++) host[i]=i & 0xff;
+  var buffer=context.createBuffer(webcl.MEM_READ_WRITE, size);
+
+  function write() { queue.enqueueWriteBuffer(buffer, false, 0, size, host); }
+  function read() { queue.enqueueReadBuffer(buffer, true, 0, size, back); }
+
+  queue.useStagingPool(false);
+  var w0=bandwidth(write, size), r0=bandwidth(read, size);
+
+  queue.useStagingPool(true);
+  var w1=bandwidth(write, size), r1=bandwidth(read, size);
+
+  // data round trips unchanged through the pool
+  for(var i=0;i<size;i+=4093)
+    assert.equal(back[i], i & 0xff);
+
+  log((size>>10)+' KB  write: '+w0+' pageable, '+w1+' pinned pool'+
+      '  read: '+r0+' pageable, '+r1+' pinned pool');
+  buffer.release();
+});
+
+// reads through the pool land in the caller's array, also for views that
+// don't start at the beginning of their ArrayBuffer
+(function() {
+  var N=100000;
+  var buffer=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+  var src=new Float32Array(N+16).subarray(16);
+  for(var i=0;i<N;i++) src[i]=i*0.5;
+  queue.useStagingPool(true);
+  queue.enqueueWriteBuffer(buffer, false, 0, N*4, src);
+
+  var dst=new Float32Array(N+8).subarray(8);
+  queue.enqueueReadBuffer(buffer, true, 0, N*4, dst);
+  for(var i=0;i<N;i++)
+    assert.equal(dst[i], i*0.5, 'float '+i);
+
+  var bytes=new Uint8Array(N*4);
+  queue.enqueueReadBuffer(buffer, true, 0, N*4, bytes.buffer);
+  assert.equal(new Float32Array(bytes.buffer)[N-1], (N-1)*0.5);
+  queue.useStagingPool(false);
+  buffer.release();
+  log('pooled reads fill the caller array');
+})();
+
+var stats=context.getStagingPool().stats();
+log('pool: '+stats.hits+' hits, '+stats.misses+' misses, '+stats.waits+' waits, '+(stats.bytesAllocated>>20)+' MB allocated');
+context.getStagingPool().release();
+
+webcl.releaseAll();
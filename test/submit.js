@@ -0,0 +1,122 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Batch submission with WebCLCommandStream: a frame of small commands is
+// recorded once per frame and submitted with a single native call, then the
+// same frame is issued with individual enqueue calls for comparison.
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var N=1024;
+var COMMANDS_PER_FRAME=200;
+var FRAMES=100;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void inc(__global uint *a, uint n)  ",
+"{                                            ",
+"  size_t i = get_global_id(0);               ",
+"  if(i < n) a[i] += 1;                       ",
+"}                                            "
+].join("\n"));
+program.build(device);
+var kernel=program.createKernel('inc');
+
+var size=N*Uint32Array.BYTES_PER_ELEMENT;
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, size);
+var scratch=context.createBuffer(webcl.MEM_READ_WRITE, size);
+kernel.setArg(0, buffer);
+kernel.setArg(1, new Uint32Array([N]));
+
+var input=new Uint32Array(N), output=new Uint32Array(N);
+for(var i=0;i<N;i++) input[i]=i;
+
+// one frame: upload, many small launches, copy, read back
+function recordFrame(cs) {
+  cs.enqueueWriteBuffer(buffer, false, 0, size, input);
+  for(var i=0;i<COMMANDS_PER_FRAME-3;i++)
+    cs.enqueueNDRangeKernel(kernel, 1, null, [N], null);
+  cs.enqueueCopyBuffer(buffer, scratch, 0, 0, size);
+  cs.enqueueReadBuffer(scratch, false, 0, size, output);
+  return cs;
+}
+
+// correctness
+var cs=new webcl.WebCLCommandStream();
+var done=new webcl.WebCLEvent();
+recordFrame(cs).enqueueMarker(done);
+queue.submit(cs);
+queue.finish();
+assert.equal(done.getInfo(webcl.EVENT_COMMAND_EXECUTION_STATUS), webcl.COMPLETE);
+for(var i=0;i<N;i++)
+  assert.equal(output[i], i+COMMANDS_PER_FRAME-3);
+log('submit: results are correct');
+
+// host-side cost per frame
+function time(name, frame) {
+  var elapsed=0;
+  for(var f=0;f<FRAMES;f++) {
+    var start=process.hrtime();
+    frame();
+    var d=process.hrtime(start);
+    elapsed+=d[0]*1e9 + d[1];
+    queue.finish();
+  }
+  log('  '+name+': '+(elapsed/FRAMES/1e3).toFixed(1)+' us/frame of '+COMMANDS_PER_FRAME+' commands');
+}
+
+time('individual enqueues', function() {
+  queue.enqueueWriteBuffer(buffer, false, 0, size, input);
+  for(var i=0;i<COMMANDS_PER_FRAME-3;i++)
+    queue.enqueueNDRangeKernel(kernel, 1, null, [N], null);
+  queue.enqueueCopyBuffer(buffer, scratch, 0, 0, size);
+  queue.enqueueReadBuffer(scratch, false, 0, size, output);
+});
+
+time('record + submit', function() {
+  cs.reset();
+  queue.submit(recordFrame(cs));
+});
+
+cs.reset();
+recordFrame(cs);
+time('submit pre-recorded stream', function() {
+  queue.submit(cs);
+});
+
+webcl.releaseAll();
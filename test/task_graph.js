@@ -0,0 +1,157 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Task graphs: two independent pipelines (upload, several kernel passes,
+// download) and a final pass joining them are described once and run
+// through WebCLTaskGraph on an out-of-order queue when the device has one,
+// and on two in-order queues. Results and run times are compared with the
+// same commands issued on a single in-order queue.
+//
+// usage: node task_graph.js [passes]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var N=1<<20, PASSES=parseInt(process.argv[2]) || 8, RUNS=20;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var device=context.getInfo(webcl.CONTEXT_DEVICES)[0];
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void step(__global float *a, float k)                        ",
+"{                                                                     ",
+"  size_t i = get_global_id(0);                                        ",
+"  a[i] = a[i] * k + 1.0f;                                             ",
+"}                                                                     ",
+"__kernel void join(__global float *dst, __global const float *a,      ",
+"                   __global const float *b)                           ",
+"{                                                                     ",
+"  size_t i = get_global_id(0);                                        ",
+"  dst[i] = a[i] + b[i];                                               ",
+"}                                                                     "
+].join("\n"));
+program.build(device);
+var step=program.createKernel('step'), join=program.createKernel('join');
+
+var hostA=new Float32Array(N), hostB=new Float32Array(N);
+for(var i=0;i<N;i++) { hostA[i]=i%13; hostB[i]=i%7; }
+var outA=new Float32Array(N), outB=new Float32Array(N), outJ=new Float32Array(N);
+
+var bufA=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+var bufB=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+var bufJ=context.createBuffer(webcl.MEM_READ_WRITE, N*4);
+var half=new Float32Array([0.5]), twice=new Float32Array([2]);
+
+function build(queues) {
+  var g=new webcl.WebCLTaskGraph(queues);
+  g.write(bufA, 0, N*4, hostA);
+  g.write(bufB, 0, N*4, hostB);
+  for(var p=0;p<PASSES;p++) {
+    g.kernel(step, [N], { args: [bufA, half], reads: [bufA], writes: [bufA] });
+    g.kernel(step, [N], { args: [bufB, twice], reads: [bufB], writes: [bufB] });
+  }
+  g.read(bufA, 0, N*4, outA);
+  g.read(bufB, 0, N*4, outB);
+  g.kernel(join, [N], { args: [bufJ, bufA, bufB], reads: [bufA, bufB], writes: [bufJ] });
+  g.read(bufJ, 0, N*4, outJ);
+  return g;
+}
+
+// expected results, computed on one in-order queue
+var queue=context.createCommandQueue(device);
+function serial() {
+  queue.enqueueWriteBuffer(bufA, false, 0, N*4, hostA);
+  queue.enqueueWriteBuffer(bufB, false, 0, N*4, hostB);
+  for(var p=0;p<PASSES;p++) {
+    step.setArg(0, bufA); step.setArg(1, half);
+    queue.enqueueNDRangeKernel(step, 1, null, [N], null);
+    step.setArg(0, bufB); step.setArg(1, twice);
+    queue.enqueueNDRangeKernel(step, 1, null, [N], null);
+  }
+  join.setArg(0, bufJ); join.setArg(1, bufA); join.setArg(2, bufB);
+  queue.enqueueNDRangeKernel(join, 1, null, [N], null);
+  queue.enqueueReadBuffer(bufA, false, 0, N*4, outA);
+  queue.enqueueReadBuffer(bufB, false, 0, N*4, outB);
+  queue.enqueueReadBuffer(bufJ, true, 0, N*4, outJ);
+}
+serial();
+var expectA=new Float32Array(outA), expectB=new Float32Array(outB), expectJ=new Float32Array(outJ);
+
+var start=process.hrtime();
+for(var r=0;r<RUNS;r++) serial();
+var diff=process.hrtime(start);
+log('single in-order queue: '+((diff[0]*1e3+diff[1]/1e6)/RUNS).toFixed(2)+' ms/run');
+
+function check(name) {
+  for(var i=0;i<N;i+=4099) {
+    assert.equal(outA[i], expectA[i], name+': a['+i+']');
+    assert.equal(outB[i], expectB[i], name+': b['+i+']');
+    assert.equal(outJ[i], expectJ[i], name+': join['+i+']');
+  }
+}
+
+function time(name, graph) {
+  outA.fill(0); outB.fill(0); outJ.fill(0);
+  return graph.run().then(function() {
+    check(name);
+    var start=process.hrtime(), r=0;
+    function next() {
+      if(r++ == RUNS) {
+        var diff=process.hrtime(start);
+        log(name+': '+((diff[0]*1e3+diff[1]/1e6)/RUNS).toFixed(2)+' ms/run');
+        return;
+      }
+      return graph.run().then(next);
+    }
+    return next();
+  });
+}
+
+var graphs=[['two in-order queues', build([context.createCommandQueue(device), context.createCommandQueue(device)])]];
+try {
+  var ooo=context.createCommandQueue(device, webcl.QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+  graphs.unshift(['out-of-order queue', build([ooo])]);
+}
+catch(ex) {
+  log('no out-of-order queue on this device');
+}
+
+graphs.reduce(function(p, g) {
+  return p.then(function() { return time(g[0], g[1]); });
+}, Promise.resolve()).then(function() {
+  webcl.releaseAll();
+}, function(err) {
+  log(err.stack || err);
+  process.exit(1);
+});
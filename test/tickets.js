@@ -0,0 +1,132 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Ticket completion mode: enqueues many small kernels, tracking completion
+// once with a WebCLEvent per command and once with tickets, and reports the
+// rate of each along with the heap growth it caused. Also checks that
+// writes staged through the pool return tickets.
+//
+// usage: node tickets.js [commands]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert');
+
+var COMMANDS=parseInt(process.argv[2]) || 50000;
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram([
+"__kernel void inc(__global uint *a)  ",
+"{                                    ",
+"  a[get_global_id(0)] += 1;          ",
+"}                                    "
+].join("\n"));
+program.build(device);
+var kernel=program.createKernel('inc');
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, 256*4);
+queue.enqueueFillBuffer(buffer, new Uint32Array(1), 0, 256*4);
+kernel.setArg(0, buffer);
+
+function measure(name, body) {
+  queue.finish();
+  var heap=process.memoryUsage().heapUsed;
+  var start=process.hrtime();
+  body();
+  var diff=process.hrtime(start);
+  var ms=diff[0]*1e3+diff[1]/1e6;
+  log(name+': '+(COMMANDS/ms*1e3).toFixed(0)+' commands/s, heap +'+
+      ((process.memoryUsage().heapUsed-heap)/1048576).toFixed(1)+' MB');
+}
+
+measure('events ', function() {
+  var events=[];
+  for(var i=0;i<COMMANDS;i++) {
+    var ev=new webcl.WebCLEvent();
+    queue.enqueueNDRangeKernel(kernel, 1, null, [256], null, null, ev);
+    events.push(ev);
+  }
+  webcl.waitForEvents(events.slice(-1));
+});
+
+queue.setTicketMode(true);
+var first, last;
+measure('tickets', function() {
+  for(var i=0;i<COMMANDS;i++) {
+    last=queue.enqueueNDRangeKernel(kernel, 1, null, [256], null);
+    if(i===0) first=last;
+  }
+  queue.waitTicket(last);
+});
+
+// tickets are consecutive, and waiting retires all of them
+assert.equal(last-first, COMMANDS-1);
+assert(queue.completedUpTo()>=last);
+assert.throws(function() { queue.waitTicket(last+1); });
+
+// each kernel added one to every element
+var host=new Uint32Array(256);
+queue.enqueueReadBuffer(buffer, true, 0, 256*4, host);
+assert.equal(host[0], 2*COMMANDS);
+
+// commands given an event don't take a ticket
+var ev=new webcl.WebCLEvent();
+assert.equal(queue.enqueueNDRangeKernel(kernel, 1, null, [256], null, null, ev), undefined);
+
+// writes through the staging pool take a ticket too, and the pool reuses
+// their pinned regions once the tickets have completed
+var data=new Uint32Array(256);
+for(var i=0;i<data.length;i++) data[i]=i;
+queue.useStagingPool(true);
+var pool=queue.getInfo(webcl.QUEUE_CONTEXT).getStagingPool();
+var misses=pool.stats().misses;
+var t1=queue.enqueueWriteBuffer(buffer, false, 0, 256*4, data);
+assert.equal(typeof t1, 'number');
+var t2=queue.enqueueWriteBuffer(buffer, false, 0, 256*4, data);
+assert.equal(t2, t1+1);
+queue.waitTicket(t2);
+var t3=queue.enqueueWriteBuffer(buffer, false, 0, 256*4, data);
+assert.equal(t3, t2+1);
+assert(pool.stats().misses-misses <= 2);
+queue.waitTicket(t3);
+queue.useStagingPool(false);
+queue.enqueueReadBuffer(buffer, true, 0, 256*4, host);
+assert.equal(host[255], 255);
+
+queue.setTicketMode(false);
+assert.equal(queue.enqueueNDRangeKernel(kernel, 1, null, [256], null), undefined);
+queue.finish();
+
+webcl.releaseAll();
@@ -0,0 +1,95 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Streams a file into a device buffer with WebCLBufferWriteStream, checks the
+// uploaded bytes and reports throughput and peak RSS against reading the
+// whole file into memory first.
+//
+// usage: node upload_stream.js [size in MB]
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var assert=require('assert'),
+    fs=require('fs'),
+    os=require('os'),
+    path=require('path');
+
+var SIZE=(parseInt(process.argv[2]) || 256)*1024*1024;
+var file=path.join(os.tmpdir(), 'webcl_upload_stream.bin');
+
+// pattern file: byte i is (i*7) & 0xff
+var block=new Buffer(1024*1024);
+for(var i=0;i<block.length;i++) block[i]=(i*7) & 0xff;
+var fd=fs.openSync(file, 'w');
+for(var off=0;off<SIZE;off+=block.length)
+  fs.writeSync(fd, block, 0, Math.min(block.length, SIZE-off));
+fs.closeSync(fd);
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var buffer=context.createBuffer(webcl.MEM_READ_WRITE, SIZE);
+
+var rss0=process.memoryUsage().rss;
+var sink=new webcl.WebCLBufferWriteStream(queue, buffer, { chunkSize: 4*1024*1024, depth: 3 });
+fs.createReadStream(file, { highWaterMark: 1024*1024 }).pipe(sink);
+
+sink.on('error', function(err) {
+  log('upload failed: '+err);
+  process.exit(-1);
+});
+
+sink.on('finish', function() {
+  var stats=sink.stats();
+  assert.equal(stats.bytes, SIZE);
+  log('stream:   '+stats.throughput.toFixed(1)+' MB/s, RSS +'+
+      ((process.memoryUsage().rss-rss0)/1e6).toFixed(1)+' MB');
+
+  // spot check the last MB
+  var tail=new Uint8Array(1024*1024);
+  queue.enqueueReadBuffer(buffer, true, SIZE-tail.length, tail.length, tail);
+  for(var i=0;i<tail.length;i++)
+    assert.equal(tail[i], ((SIZE-tail.length+i)*7) & 0xff);
+
+  // the same upload reading the whole file first
+  var start=process.hrtime();
+  var data=fs.readFileSync(file);
+  queue.enqueueWriteBuffer(buffer, true, 0, SIZE, data);
+  var diff=process.hrtime(start);
+  log('one-shot: '+(SIZE/(diff[0]+diff[1]/1e9)/1e6).toFixed(1)+' MB/s, RSS +'+
+      ((process.memoryUsage().rss-rss0)/1e6).toFixed(1)+' MB');
+
+  fs.unlinkSync(file);
+  webcl.releaseAll();
+});
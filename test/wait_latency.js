@@ -0,0 +1,146 @@
+// Copyright (c) 2011-2012, Motorola Mobility, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of the Motorola Mobility, Inc. nor the names of its
+//    contributors may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Event loop latency while many asynchronous waitForEvents() are pending.
+// The blocking waits must run on the libuv threadpool, so a timer ticking
+// on the JS thread should keep firing on time while kernels complete.
+
+// one thread per pending wait, must be set before the threadpool starts
+var NUM_WAITS = 100;
+process.env.UV_THREADPOOL_SIZE = process.env.UV_THREADPOOL_SIZE || NUM_WAITS;
+
+var nodejs = (typeof window === 'undefined');
+if(nodejs) {
+  require('../webcl');
+  clu = require('../lib/clUtils');
+  log=console.log;
+}
+else
+  WebCL = window.webcl;
+
+var ITERATIONS = 1<<16;  // loop count in each kernel
+var TICK_MS    = 1;      // timer period used to probe the event loop
+
+var kernelSource = [
+"__kernel void spin(__global float *out, uint n)           ",
+"{                                                         ",
+"  size_t i = get_global_id(0);                            ",
+"  float x = (float) i;                                    ",
+"  for(uint k=0; k<n; k++) x = x * 0.999f + 1.0f;          ",
+"  out[i] = x;                                             ",
+"}                                                         "
+].join("\n");
+
+var context=webcl.createContext(webcl.DEVICE_TYPE_DEFAULT);
+var queue=context.createCommandQueue();
+var device=queue.getInfo(webcl.QUEUE_DEVICE);
+log('using device: '+device.getInfo(webcl.DEVICE_NAME));
+
+var program=context.createProgram(kernelSource);
+program.build(device);
+var kernel=program.createKernel('spin');
+
+var N=1024;
+var out=context.createBuffer(webcl.MEM_WRITE_ONLY, N*Float32Array.BYTES_PER_ELEMENT);
+kernel.setArg(0, out);
+kernel.setArg(1, new Uint32Array([ITERATIONS]));
+
+// probe the event loop with a fast timer and record how late it fires
+function LagProbe() {
+  this.max=0;
+  this.total=0;
+  this.count=0;
+  var self=this, last=process.hrtime();
+  this.timer=setInterval(function() {
+    var d=process.hrtime(last);
+    var lag=d[0]*1e3 + d[1]/1e6 - TICK_MS;
+    if(lag>self.max) self.max=lag;
+    self.total+=lag;
+    self.count++;
+    last=process.hrtime();
+  }, TICK_MS);
+}
+LagProbe.prototype.stop=function() {
+  clearInterval(this.timer);
+  return { max: this.max, avg: this.count ? this.total/this.count : 0, ticks: this.count };
+}
+
+function enqueueBatch() {
+  var events=[];
+  for(var i=0;i<NUM_WAITS;i++) {
+    var ev=new webcl.WebCLEvent();
+    queue.enqueueNDRangeKernel(kernel, 1, null, [N], null, null, ev);
+    events.push(ev);
+  }
+  queue.flush();
+  return events;
+}
+
+function report(name, elapsed, lag) {
+  log(name+': '+NUM_WAITS+' waits in '+elapsed.toFixed(2)+' ms, event loop lag max '+
+      lag.max.toFixed(2)+' ms, avg '+lag.avg.toFixed(3)+' ms over '+lag.ticks+' ticks');
+}
+
+// synchronous waits, for reference: the loop is blocked for the whole batch
+function testSync(next) {
+  var events=enqueueBatch();
+  var probe=new LagProbe();
+  var start=process.hrtime();
+  setTimeout(function() {
+    for(var i=0;i<events.length;i++)
+      webcl.waitForEvents([events[i]]);
+    var d=process.hrtime(start);
+    setTimeout(function() {
+      report('sync ', d[0]*1e3 + d[1]/1e6, probe.stop());
+      next();
+    }, 5*TICK_MS);
+  }, 5*TICK_MS);
+}
+
+// 100 concurrent asynchronous waits
+function testAsync(next) {
+  var events=enqueueBatch();
+  var probe=new LagProbe();
+  var start=process.hrtime();
+  var pending=events.length;
+  events.forEach(function(ev) {
+    webcl.waitForEvents([ev], function(status) {
+      if(status<0) log('Error: '+status);
+      if(--pending === 0) {
+        var d=process.hrtime(start);
+        report('async', d[0]*1e3 + d[1]/1e6, probe.stop());
+        next();
+      }
+    });
+  });
+}
+
+testSync(function() {
+  testAsync(function() {
+    queue.finish();
+    webcl.releaseAll();
+  });
+});
@@ -97,6 +97,78 @@ function isArray(obj) {
   return Object.prototype.toString.call(obj) === '[object Array]';
 }
 
+// byte offsets and sizes may be Numbers or BigInts
+function isSize(v) {
+  return typeof v === 'number' || typeof v === 'bigint';
+}
+
+// sizes are passed to the native layer as Numbers, which are exact up to 2^53
+function toSize(v) {
+  if (typeof v === 'bigint') {
+    if (v < 0 || v > Number.MAX_SAFE_INTEGER)
+      throw new RangeError('size '+v+' is out of range');
+    return Number(v);
+  }
+  return v;
+}
+
+// buffers bound to kernel that prefer another queue than queue's device,
+// grouped by that queue. Returns null when there are none.
+function preferredElsewhere(kernel, queue) {
+  var groups=null;
+  for (var i=0; i<kernel._memArgs.length; i++) {
+    var buffer=kernel._memArgs[i];
+    if (!buffer || !buffer._preferredQueue || buffer._preferredQueue === queue)
+      continue;
+    groups=groups || [];
+    var group=null;
+    for (var j=0; j<groups.length; j++) {
+      if (groups[j].queue === buffer._preferredQueue)
+        group=groups[j];
+    }
+    if (!group)
+      groups.push(group={ queue: buffer._preferredQueue, buffers: [] });
+    if (group.buffers.indexOf(buffer) < 0)
+      group.buffers.push(buffer);
+  }
+  return groups;
+}
+
+// moves buffers back to their preferred device as soon as the launch that
+// used them on another device completes, so the transfer overlaps with
+// whatever that device is running meanwhile. event is the launch's, or null
+// when the caller didn't ask for one. The launching queue is flushed by its
+// own policy; the migration queues are flushed here, as nothing else on them
+// would submit the migrations. A marker made here is released once the
+// migrations are enqueued; they hold their own reference to it.
+function prefetchAfter(queue, groups, event) {
+  var marker=null;
+  if (!event)
+    queue.enqueueMarker(event=marker=new cl.WebCLEvent());
+  try {
+    for (var i=0; i<groups.length; i++) {
+      groups[i].queue.enqueueMigrateMemObjects(groups[i].buffers, 0, [event]);
+      groups[i].queue.flush();
+    }
+  }
+  finally {
+    if (marker)
+      marker.release();
+  }
+}
+
+// command stream a recording queue appends to. Graphs are replayed as a
+// whole, so recorded commands can't wait on events from outside.
+function recorder(queue, name, event_list) {
+  if (event_list!=null && event_list.length)
+    throw new Error('WebCLCommandQueue.'+name+'(): event_list can not be recorded, use enqueueBarrier()');
+  return queue._recorder;
+}
+
+function notRecordable(name) {
+  throw new Error('WebCLCommandQueue.'+name+'() can not be recorded in a WebCLCommandGraph');
+}
+
 var _getPlatforms = cl.getPlatforms;
 cl.getPlatforms = function () {
   if (!(arguments.length === 0)) {
@@ -143,6 +215,22 @@ cl.waitForEvents = function (events, callback) {
   return _waitForEvents(events, callback);
 }
 
+// One native registration for many events, instead of a setCallback each.
+// onComplete(events, callback) calls callback(status) once all events have
+// completed, status is the first failure or webcl.COMPLETE.
+// onComplete(events, callback, { batchMilliseconds: N }) calls
+// callback(indices, statuses, done) with the completions seen since the
+// last call, at most every N ms; done is true on the last call.
+var _onComplete = cl.onComplete;
+cl.onComplete = function (events, callback, options) {
+  if (!(arguments.length >= 2 && isArray(events) && typeof callback === 'function' &&
+    (options == null || typeof options === 'object'))) {
+    throw new TypeError('Expected onComplete(WebCLEvent[] events, function callback, optional object options)');
+  }
+  var batched=!!(options && 'batchMilliseconds' in options);
+  return _onComplete(events, callback, batched, batched ? (options.batchMilliseconds || 0) : 0);
+}
+
 var _releaseAll = cl.releaseAll;
 cl.releaseAll = function (atExit) {
   return _releaseAll(atExit);
@@ -171,7 +259,15 @@ cl.WebCLCommandQueue.prototype.enqueueNDRangeKernel=function (kernel, workDim, o
       )) {
     throw new TypeError('Expected WebCLCommandQueue.enqueueNDRangeKernel(WebCLKernel kernel, int workDim, int[3] offsets, int[3] globals, int[3] locals, WebCLEvent[] event_list, WebCLEvent event)');
   }
-  return this._enqueueNDRangeKernel(kernel, workDim, offsets, globals, locals, event_list, event);
+  if (this._recorder) {
+    recorder(this, 'enqueueNDRangeKernel', event_list).enqueueNDRangeKernel(kernel, workDim, offsets, globals, locals, event);
+    return;
+  }
+  var groups=kernel._memArgs ? preferredElsewhere(kernel, this) : null;
+  var ret=this._enqueueNDRangeKernel(kernel, workDim, offsets, globals, locals, event_list, event);
+  if (groups)
+    prefetchAfter(this, groups, event);
+  return ret;
 }
 
 cl.WebCLCommandQueue.prototype.enqueueTask=function (kernel, event_list, event) {
@@ -181,14 +277,22 @@ cl.WebCLCommandQueue.prototype.enqueueTask=function (kernel, event_list, event)
     )) {
     throw new TypeError('Expected WebCLCommandQueue.enqueueTask(WebCLKernel kernel, WebCLEvent[] event_list, WebCLEvent event)');
   }
-  return this._enqueueTask(kernel, event_list, event);
+  if (this._recorder) {
+    recorder(this, 'enqueueTask', event_list).enqueueNDRangeKernel(kernel, 1, null, [1], [1], event);
+    return;
+  }
+  var groups=kernel._memArgs ? preferredElsewhere(kernel, this) : null;
+  var ret=this._enqueueTask(kernel, event_list, event);
+  if (groups)
+    prefetchAfter(this, groups, event);
+  return ret;
 }
 
 cl.WebCLCommandQueue.prototype.enqueueWriteBuffer=function (buffer, blocking_write, offset, sizeInBytes, ptr, event_list, event) {
     if (!(arguments.length >= 5 &&
       checkObjectType(buffer, 'WebCLBuffer') &&
       (typeof blocking_write === 'boolean' || typeof blocking_write === 'number') &&
-      typeof offset === 'number' && typeof sizeInBytes === 'number' &&
+      isSize(offset) && isSize(sizeInBytes) &&
       typeof ptr === 'object' &&
       (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
       (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
@@ -196,7 +300,15 @@ cl.WebCLCommandQueue.prototype.enqueueWriteBuffer=function (buffer, blocking_wri
         throw new TypeError('Expected WebCLCommandQueue.enqueueWriteBuffer(WebCLBuffer buffer, boolean blocking_write, ' +
             'uint offset, uint sizeInBytes, ArrayBuffer ptr, WebCLEvent[] event_list, WebCLEvent event)');
     }
-    return this._enqueueWriteBuffer(buffer, blocking_write, offset, sizeInBytes, ptr, event_list, event);
+    if (this._recorder) {
+      recorder(this, 'enqueueWriteBuffer', event_list).enqueueWriteBuffer(buffer, blocking_write, toSize(offset), toSize(sizeInBytes), ptr, event);
+      return;
+    }
+    var staged=this._stagingPool &&
+        this._stagingPool.write(this, buffer, blocking_write, toSize(offset), toSize(sizeInBytes), ptr, event_list, event);
+    if (staged)
+      return staged.result;
+    return this._enqueueWriteBuffer(buffer, blocking_write, toSize(offset), toSize(sizeInBytes), ptr, event_list, event);
 }
 
 cl.WebCLCommandQueue.prototype.enqueueReadBuffer=function (buffer, blocking_read, offset, cb, ptr, event_list, event) {
@@ -204,7 +316,7 @@ cl.WebCLCommandQueue.prototype.enqueueReadBuffer=function (buffer, blocking_read
   if (!(arguments.length >= 5 &&
     checkObjectType(buffer, 'WebCLBuffer') &&
     (typeof blocking_read === 'boolean' || typeof blocking_read === 'number') &&
-    typeof offset === 'number' && typeof cb === 'number' &&
+    isSize(offset) && isSize(cb) &&
     typeof ptr === 'object' &&
     (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
     (event == null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
@@ -212,7 +324,15 @@ cl.WebCLCommandQueue.prototype.enqueueReadBuffer=function (buffer, blocking_read
       throw new TypeError('Expected WebCLCommandQueue.enqueueReadBuffer(WebCLBuffer buffer, boolean blocking_read, ' +
           'uint offset, uint cb, ArrayBuffer ptr, WebCLEvent[] event_list, WebCLEvent event)');
     }
-    return this._enqueueReadBuffer(buffer, blocking_read, offset, cb, ptr, event_list, event);
+    if (this._recorder) {
+      recorder(this, 'enqueueReadBuffer', event_list).enqueueReadBuffer(buffer, blocking_read, toSize(offset), toSize(cb), ptr, event);
+      return;
+    }
+    var staged=this._stagingPool &&
+        this._stagingPool.read(this, buffer, blocking_read, toSize(offset), toSize(cb), ptr, event_list, event);
+    if (staged)
+      return staged.result;
+    return this._enqueueReadBuffer(buffer, blocking_read, toSize(offset), toSize(cb), ptr, event_list, event);
 }
 
 cl.WebCLCommandQueue.prototype.enqueueCopyBuffer=function (src_buffer, dst_buffer,
@@ -221,7 +341,7 @@ cl.WebCLCommandQueue.prototype.enqueueCopyBuffer=function (src_buffer, dst_buffe
   if (!(arguments.length >= 5 &&
       checkObjectType(src_buffer, 'WebCLBuffer') &&
       checkObjectType(dst_buffer, 'WebCLBuffer') &&
-      typeof src_offset === 'number' && typeof dst_offset === 'number' && typeof size === 'number' &&
+      isSize(src_offset) && isSize(dst_offset) && isSize(size) &&
       (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
       (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
   )) {
@@ -229,17 +349,58 @@ cl.WebCLCommandQueue.prototype.enqueueCopyBuffer=function (src_buffer, dst_buffe
         'int src_offset, int dst_offset, int size, ' +
         'WebCLEvent[] event_list, WebCLEvent event)');
   }
+  if (this._recorder) {
+    recorder(this, 'enqueueCopyBuffer', event_list).enqueueCopyBuffer(src_buffer, dst_buffer,
+        toSize(src_offset), toSize(dst_offset), toSize(size), event);
+    return;
+  }
   return this._enqueueCopyBuffer(src_buffer, dst_buffer,
-                                 src_offset, dst_offset, size,
+                                 toSize(src_offset), toSize(dst_offset), toSize(size),
                                  event_list, event);
 }
 
+// ranges: packed (deviceOffset, hostOffset, length) triples in a Uint32Array,
+// Float64Array or Array. Adjacent ranges are merged and short ones travel
+// together through one staging buffer.
+cl.WebCLCommandQueue.prototype.enqueueWriteBufferScatter=function (buffer, blocking_write, ranges, ptr, event_list, event) {
+  if (this._recorder) notRecordable('enqueueWriteBufferScatter');
+  if (!(arguments.length >= 4 &&
+    checkObjectType(buffer, 'WebCLBuffer') &&
+    (typeof blocking_write === 'boolean' || typeof blocking_write === 'number') &&
+    typeof ranges === 'object' &&
+    typeof ptr === 'object' &&
+    (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
+    (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
+  )) {
+    throw new TypeError('Expected WebCLCommandQueue.enqueueWriteBufferScatter(WebCLBuffer buffer, boolean blocking_write, ' +
+        'uint[] ranges, ArrayBuffer ptr, WebCLEvent[] event_list, WebCLEvent event)');
+  }
+  return this._enqueueWriteBufferScatter(buffer, blocking_write, ranges, ptr, event_list, event);
+}
+
+cl.WebCLCommandQueue.prototype.enqueueReadBufferGather=function (buffer, blocking_read, ranges, ptr, event_list, event) {
+  if (this._recorder) notRecordable('enqueueReadBufferGather');
+  if (!(arguments.length >= 4 &&
+    checkObjectType(buffer, 'WebCLBuffer') &&
+    (typeof blocking_read === 'boolean' || typeof blocking_read === 'number') &&
+    typeof ranges === 'object' &&
+    typeof ptr === 'object' &&
+    (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
+    (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
+  )) {
+    throw new TypeError('Expected WebCLCommandQueue.enqueueReadBufferGather(WebCLBuffer buffer, boolean blocking_read, ' +
+        'uint[] ranges, ArrayBuffer ptr, WebCLEvent[] event_list, WebCLEvent event)');
+  }
+  return this._enqueueReadBufferGather(buffer, blocking_read, ranges, ptr, event_list, event);
+}
+
 cl.WebCLCommandQueue.prototype.enqueueWriteBufferRect=function (buffer, blocking_write,
                                                                 buffer_origin, host_origin, region,
                                                                 buffer_row_pitch, buffer_slice_pitch,
                                                                 host_row_pitch, host_slice_pitch,
                                                                 ptr,
                                                                 event_list, event) {
+  if (this._recorder) notRecordable('enqueueWriteBufferRect');
     if (!(arguments.length >= 9 &&
       checkObjectType(buffer, 'WebCLBuffer') &&
       (typeof blocking_write === 'boolean' || typeof blocking_write === 'number') &&
@@ -269,6 +430,7 @@ cl.WebCLCommandQueue.prototype.enqueueReadBufferRect=function (buffer, blocking_
                                                                host_row_pitch, host_slice_pitch,
                                                                ptr,
                                                                event_list, event) {
+  if (this._recorder) notRecordable('enqueueReadBufferRect');
     if (!(arguments.length >= 9 &&
       checkObjectType(buffer, 'WebCLBuffer') &&
       (typeof blocking_read === 'boolean' || typeof blocking_read === 'number') &&
@@ -297,6 +459,7 @@ cl.WebCLCommandQueue.prototype.enqueueCopyBufferRect=function (src_buffer, dst_b
                                                                src_row_pitch, src_slice_pitch,
                                                                dst_row_pitch, dst_slice_pitch,
                                                                event_list, event) {
+  if (this._recorder) notRecordable('enqueueCopyBufferRect');
   if (!(arguments.length >= 9 &&
     checkObjectType(src_buffer, 'WebCLBuffer') && checkObjectType(dst_buffer, 'WebCLBuffer') &&
     typeof src_origin === 'object' && typeof dst_origin === 'object' && typeof region === 'object' &&
@@ -319,6 +482,7 @@ cl.WebCLCommandQueue.prototype.enqueueCopyBufferRect=function (src_buffer, dst_b
 }
 
 cl.WebCLCommandQueue.prototype.enqueueWriteImage=function (image, blocking_write, origin, region, row_pitch, ptr, event_list, event) {
+  if (this._recorder) notRecordable('enqueueWriteImage');
   //console.log('checking object: type: '+Object.prototype.toString.call(ptr)+' for typeof: '+typeof(ptr));
   if (!(arguments.length >= 6 &&
     checkObjectType(image, 'WebCLImage') &&
@@ -337,6 +501,7 @@ cl.WebCLCommandQueue.prototype.enqueueWriteImage=function (image, blocking_write
 
 cl.WebCLCommandQueue.prototype.enqueueReadImage=function (image, blocking_read, origin, region, row_pitch,
                                                           ptr, event_list, event) {
+  if (this._recorder) notRecordable('enqueueReadImage');
   if (!(arguments.length >= 6 &&
     checkObjectType(image, 'WebCLImage') &&
     typeof origin === 'object' &&
@@ -355,6 +520,7 @@ cl.WebCLCommandQueue.prototype.enqueueReadImage=function (image, blocking_read,
 
 cl.WebCLCommandQueue.prototype.enqueueCopyImage=function (src_image, dst_image, src_origin, dst_origin, region,
                                                           event_list, event) {
+  if (this._recorder) notRecordable('enqueueCopyImage');
   if (!(arguments.length >= 5 &&
     checkObjectType(src_image, 'WebCLImage') &&
     checkObjectType(dst_image, 'WebCLImage') &&
@@ -373,6 +539,7 @@ cl.WebCLCommandQueue.prototype.enqueueCopyImage=function (src_image, dst_image,
 
 cl.WebCLCommandQueue.prototype.enqueueCopyImageToBuffer=function (src_image, dst_buffer, src_origin, region, dst_offset,
                                                                   event_list, event) {
+  if (this._recorder) notRecordable('enqueueCopyImageToBuffer');
   if (!(arguments.length >= 5 &&
     checkObjectType(src_image, 'WebCLImage') &&
     checkObjectType(dst_buffer, 'WebCLBuffer') &&
@@ -391,6 +558,7 @@ cl.WebCLCommandQueue.prototype.enqueueCopyImageToBuffer=function (src_image, dst
 
 cl.WebCLCommandQueue.prototype.enqueueCopyBufferToImage=function (src_buffer, dst_image, src_offset, dst_origin,
                                                                   region, event_list, event) {
+  if (this._recorder) notRecordable('enqueueCopyBufferToImage');
   if (!(arguments.length >= 5 &&
     checkObjectType(src_buffer, 'WebCLBuffer') &&
     checkObjectType(dst_image, 'WebCLImage') &&
@@ -406,38 +574,94 @@ cl.WebCLCommandQueue.prototype.enqueueCopyBufferToImage=function (src_buffer, ds
   return this._enqueueCopyBufferToImage(src_buffer, dst_image, src_offset, dst_origin, region, event_list, event);
 }
 
+cl.WebCLCommandQueue.prototype.enqueueFillBuffer=function (buffer, pattern, offset, size, event_list, event) {
+  if (this._recorder) notRecordable('enqueueFillBuffer');
+  if (!(arguments.length >= 4 &&
+    checkObjectType(buffer, 'WebCLBuffer') &&
+    typeof pattern === 'object' &&
+    isSize(offset) &&
+    isSize(size) &&
+    (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
+    (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
+  )) {
+    throw new TypeError('Expected WebCLCommandQueue.enqueueFillBuffer(WebCLBuffer buffer, ArrayBufferView pattern, ' +
+        'uint offset, uint size, WebCLEvent[] event_list, WebCLEvent event)');
+  }
+  return this._enqueueFillBuffer(buffer, pattern, toSize(offset), toSize(size), event_list, event);
+}
+
+cl.WebCLCommandQueue.prototype.enqueueFillImage=function (image, fill_color, origin, region, event_list, event) {
+  if (this._recorder) notRecordable('enqueueFillImage');
+  if (!(arguments.length >= 4 &&
+    checkObjectType(image, 'WebCLImage') &&
+    typeof fill_color === 'object' &&
+    typeof origin === 'object' &&
+    typeof region === 'object' &&
+    (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
+    (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
+  )) {
+    throw new TypeError('Expected WebCLCommandQueue.enqueueFillImage(WebCLImage image, number[4] fill_color, ' +
+        'uint[] origin, uint[] region, WebCLEvent[] event_list, WebCLEvent event)');
+  }
+  return this._enqueueFillImage(image, fill_color, origin, region, event_list, event);
+}
+
+cl.WebCLCommandQueue.prototype.enqueueMigrateMemObjects=function (mem_objects, flags, event_list, event) {
+  if (this._recorder) notRecordable('enqueueMigrateMemObjects');
+  if (!(arguments.length >= 2 &&
+    isArray(mem_objects) &&
+    typeof flags === 'number' &&
+    (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
+    (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
+  )) {
+    throw new TypeError('Expected WebCLCommandQueue.enqueueMigrateMemObjects(WebCLMemoryObject[] mem_objects, CLenum flags, ' +
+        'WebCLEvent[] event_list, WebCLEvent event)');
+  }
+  for (var i=0; i<mem_objects.length; i++) {
+    if (!(checkObjectType(mem_objects[i], 'WebCLBuffer') || checkObjectType(mem_objects[i], 'WebCLImage')))
+      throw new TypeError('Expected WebCLCommandQueue.enqueueMigrateMemObjects(WebCLMemoryObject[] mem_objects, ...)');
+  }
+  return this._enqueueMigrateMemObjects(mem_objects, flags, event_list, event);
+}
+
+// Returns a Buffer sharing the mapped memory. enqueueUnmapMemObject() takes
+// that very Buffer, on the queue that mapped it, and detaches it. Slices and
+// typed arrays made from it are not detached and must not outlive the unmap.
 cl.WebCLCommandQueue.prototype.enqueueMapBuffer=function (memory_object, blocking, flags, offset, size, event_list, event) {
+  if (this._recorder) notRecordable('enqueueMapBuffer');
   if (!(arguments.length >= 5 &&
     checkObjectType(memory_object, 'WebCLBuffer') &&
     (typeof blocking === 'boolean' || typeof blocking === 'number') &&
     typeof flags === 'number' &&
-    typeof offset === 'number' &&
-    typeof size === 'number' &&
+    isSize(offset) &&
+    isSize(size) &&
     (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
     (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
   )) {
     throw new TypeError('Expected WebCLCommandQueue.enqueueMapBuffer(WebCLBuffer memory_object, boolean blocking, CLenum flags, uint offset, uint size, WebCLEvent[] event_list, WebCLEvent event)');
   }
 
-  return this._enqueueMapBuffer(memory_object, blocking, flags, offset, size, event_list, event);
+  return this._enqueueMapBuffer(memory_object, blocking, flags, toSize(offset), toSize(size), event_list, event);
 }
 
 cl.WebCLCommandQueue.prototype.enqueueMapImage=function (memory_object, blocking, flags, origin, region, event_list, event) {
+  if (this._recorder) notRecordable('enqueueMapImage');
   if (!(arguments.length >= 5 &&
     checkObjectType(memory_object, 'WebCLImage') &&
     (typeof blocking === 'boolean' || typeof blocking === 'number') &&
     typeof flags === 'number' &&
-    typeof origin === 'number' &&
+    typeof origin === 'object' &&
     typeof region === 'object' &&
     (event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
     (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
   )) {
-    throw new TypeError('Expected WebCLCommandQueue.enqueueMapImage(WebCLImage memory_object, boolean blocking, CLenum flags, uint origin, WebCLRegion region, WebCLEvent[] event_list, WebCLEvent event)');
+    throw new TypeError('Expected WebCLCommandQueue.enqueueMapImage(WebCLImage memory_object, boolean blocking, CLenum flags, uint[] origin, uint[] region, WebCLEvent[] event_list, WebCLEvent event)');
   }
   return this._enqueueMapImage(memory_object, blocking, flags, origin, region, event_list, event);
 }
 
 cl.WebCLCommandQueue.prototype.enqueueUnmapMemObject=function (memory_object, region, event_list, event) {
+  if (this._recorder) notRecordable('enqueueUnmapMemObject');
   if (!(arguments.length >= 2 &&
     (checkObjectType(memory_object, 'WebCLBuffer') || checkObjectType(memory_object, 'WebCLImage')) &&
     typeof region === 'object' &&
@@ -449,14 +673,27 @@ cl.WebCLCommandQueue.prototype.enqueueUnmapMemObject=function (memory_object, re
   return this._enqueueUnmapMemObject(memory_object, region, event_list, event);
 }
 
-cl.WebCLCommandQueue.prototype.enqueueMarker=function (event) {
-  if (!(arguments.length == 1 && checkObjectType(event, 'WebCLEvent'))) {
-    throw new TypeError('Expected WebCLCommandQueue.enqueueMarker(WebCLEvent event)');
+// enqueueMarker(event) or enqueueMarker(event_list, event): the marker
+// completes with the events of event_list, or with every previous command
+cl.WebCLCommandQueue.prototype.enqueueMarker=function (event_list, event) {
+  if (arguments.length == 1 && checkObjectType(event_list, 'WebCLEvent')) {
+    event=event_list;
+    event_list=null;
   }
-  return this._enqueueMarker(event);
+  if (!((event_list==null || typeof event_list === 'undefined' || typeof event_list === 'object') &&
+      (event==null || typeof event === 'undefined' || checkObjectType(event, 'WebCLEvent'))
+      )) {
+    throw new TypeError('Expected WebCLCommandQueue.enqueueMarker(WebCLEvent[] event_list, WebCLEvent event)');
+  }
+  if (this._recorder) {
+    recorder(this, 'enqueueMarker', event_list).enqueueMarker(event);
+    return;
+  }
+  return this._enqueueMarker(event_list, event);
 }
 
 cl.WebCLCommandQueue.prototype.enqueueWaitForEvents=function (event_wait_list) {
+  if (this._recorder) notRecordable('enqueueWaitForEvents');
   if (!(arguments.length >=0 &&
       (typeof event_list === 'undefined' || event_list==null || typeof event_list === 'object') )) {
     throw new TypeError('Expected WebCLCommandQueue.enqueueWaitForEvents(WebCLEvent[] event_wait_list)');
@@ -471,6 +708,12 @@ cl.WebCLCommandQueue.prototype.enqueueBarrier=function (event_list, event) {
       )) {
     throw new TypeError('Expected WebCLCommandQueue.enqueueBarrier(WebCLEvent[] event_list, WebCLEvent event)');
   }
+  if (this._recorder) {
+    if (event!=null)
+      throw new Error('WebCLCommandQueue.enqueueBarrier(): recorded barriers have no event');
+    recorder(this, 'enqueueBarrier', event_list).enqueueBarrier();
+    return;
+  }
   return this._enqueueBarrier(event_list, event);
 }
 
@@ -481,6 +724,88 @@ cl.WebCLCommandQueue.prototype.flush=function () {
   return this._flush();
 }
 
+// policy: { commands: N, bytes: N, milliseconds: N, onWait: boolean }.
+// The queue is flushed once N commands or N bytes of transfers are pending,
+// N ms after the first pending command, or before JS waits on one of its
+// events. Missing or 0 limits are disabled.
+cl.WebCLCommandQueue.prototype.setFlushPolicy=function (policy) {
+  if (!(arguments.length === 1 && typeof policy === 'object' && policy !== null)) {
+    throw new TypeError('Expected WebCLCommandQueue.setFlushPolicy(object policy)');
+  }
+  return this._setFlushPolicy(policy.commands || 0, toSize(policy.bytes || 0),
+                              policy.milliseconds || 0, !!policy.onWait);
+}
+
+cl.WebCLCommandQueue.prototype.getFlushStats=function () {
+  return this._getFlushStats();
+}
+
+// limits: { bytes: N, commands: N }, or null to remove them. Non-blocking
+// reads and writes from or to host memory are always counted until they
+// complete, and their ArrayBufferViews kept alive meanwhile; finish() retires
+// them at once. drain() resolves once the queue is below both limits;
+// missing or 0 limits are disabled.
+cl.WebCLCommandQueue.prototype.setHighWaterMark=function (limits) {
+  if (!(arguments.length === 1 && typeof limits === 'object')) {
+    throw new TypeError('Expected WebCLCommandQueue.setHighWaterMark(object limits)');
+  }
+  if (limits === null)
+    this._setHighWaterMark(0, 0);
+  else
+    this._setHighWaterMark(toSize(limits.bytes || 0), limits.commands || 0);
+  if (this._drainWaiters && !this._getInFlight().aboveHighWater)
+    this._ondrain();
+}
+
+// { bytes, commands, peakBytes, aboveHighWater } of tracked transfers
+cl.WebCLCommandQueue.prototype.getInFlight=function () {
+  return this._getInFlight();
+}
+
+cl.WebCLCommandQueue.prototype.drain=function () {
+  var self=this;
+  if (!this._getInFlight().aboveHighWater)
+    return Promise.resolve();
+  // pending commands can only complete once they are submitted
+  this._flush();
+  return new Promise(function (resolve) {
+    (self._drainWaiters || (self._drainWaiters=[])).push(resolve);
+  });
+}
+
+// called natively when the last completion takes the queue below its limits
+cl.WebCLCommandQueue.prototype._ondrain=function () {
+  var waiters=this._drainWaiters;
+  this._drainWaiters=null;
+  if (waiters)
+    for (var i=0;i<waiters.length;i++) waiters[i]();
+}
+
+// In ticket mode, enqueue calls made without a WebCLEvent return an integer
+// ticket instead. Tickets count up from 1 in enqueue order and are tracked
+// natively, without a JS object per command.
+cl.WebCLCommandQueue.prototype.setTicketMode=function (enabled) {
+  if (!(arguments.length === 1 && (typeof enabled === 'boolean' || typeof enabled === 'number'))) {
+    throw new TypeError('Expected WebCLCommandQueue.setTicketMode(boolean enabled)');
+  }
+  var ret=this._setTicketMode(!!enabled);
+  this._ticketMode=!!enabled;
+  return ret;
+}
+
+// highest ticket n such that tickets 1..n have all completed
+cl.WebCLCommandQueue.prototype.completedUpTo=function () {
+  return this._completedUpTo();
+}
+
+// blocks until tickets 1..ticket have completed, throws if one of them failed
+cl.WebCLCommandQueue.prototype.waitTicket=function (ticket) {
+  if (!(arguments.length === 1 && isSize(ticket))) {
+    throw new TypeError('Expected WebCLCommandQueue.waitTicket(uint ticket)');
+  }
+  return this._waitTicket(toSize(ticket));
+}
+
 cl.WebCLCommandQueue.prototype.finish=function (callback) {
   if (!(arguments.length == 0 ||
     (arguments.length==1 && typeof callback === 'function'))) {
@@ -489,7 +814,65 @@ cl.WebCLCommandQueue.prototype.finish=function (callback) {
   return this._finish(callback);
 }
 
+cl.WebCLCommandQueue.prototype.finishAsync=function () {
+  if (!(arguments.length === 0)) {
+    throw new TypeError('Expected WebCLCommandQueue.finishAsync()');
+  }
+  var self=this;
+  return new Promise(function(resolve, reject) {
+    self._finish(function(status) {
+      if(status<0) {
+        var err=new Error('WebCLCommandQueue.finish failed with error '+status);
+        err.code=status;
+        return reject(err);
+      }
+      resolve(status);
+    });
+  });
+}
+
+cl.WebCLCommandQueue.prototype.submit=function (stream, objects, hosts) {
+  if(stream instanceof cl.WebCLCommandStream)
+    return this._submit(stream.words, stream.length, stream.objects, stream.hosts);
+
+  if(stream instanceof ArrayBuffer)
+    stream=new Uint32Array(stream);
+  if (!(arguments.length >= 2 && stream instanceof Uint32Array && isArray(objects) &&
+      (hosts==null || isArray(hosts)))) {
+    throw new TypeError('Expected WebCLCommandQueue.submit(WebCLCommandStream stream) or WebCLCommandQueue.submit(ArrayBuffer stream, Object[] objects, ArrayBufferView[] hosts)');
+  }
+  return this._submit(stream, stream.length, objects, hosts || []);
+}
+
+// Commands enqueued on this queue until endRecording() are recorded instead
+// of run, and endRecording() returns them as a WebCLCommandGraph. Only
+// kernels, buffer reads, writes and copies, markers and barriers can be
+// recorded. kernel.setArg() still applies at once; argument changes that
+// belong to the graph go through the returned recorder:
+//
+//   var rec=queue.beginRecording();
+//   rec.setArg(kernel, 2, webcl.graphParam(0));
+//   queue.enqueueNDRangeKernel(kernel, 1, null, [n]);
+//   var graph=queue.endRecording();
+cl.WebCLCommandQueue.prototype.beginRecording=function () {
+  if (this._recorder)
+    throw new Error('WebCLCommandQueue.beginRecording(): this queue is already recording');
+  this._recorder=new cl.WebCLCommandStream();
+  return this._recorder;
+}
+
+cl.WebCLCommandQueue.prototype.endRecording=function () {
+  if (!this._recorder)
+    throw new Error('WebCLCommandQueue.endRecording(): this queue is not recording');
+  var cs=this._recorder;
+  this._recorder=null;
+  var graph=new cl.WebCLCommandGraph(cs.words, cs.length, cs.objects, cs.hosts, cs.params);
+  graph._queue=this;
+  return graph;
+}
+
 cl.WebCLCommandQueue.prototype.enqueueAcquireGLObjects=function (mem_objects, event_list, event) {
+  if (this._recorder) notRecordable('enqueueAcquireGLObjects');
   if(!cl.WebCLDevice.prototype.enable_extensions.KHR_gl_sharing.enabled) {
     throw new WebCLException('WEBCL_EXTENSION_NOT_ENABLED');
   }
@@ -504,6 +887,7 @@ cl.WebCLCommandQueue.prototype.enqueueAcquireGLObjects=function (mem_objects, ev
 }
 
 cl.WebCLCommandQueue.prototype.enqueueReleaseGLObjects=function (mem_objects, event_list, event) {
+  if (this._recorder) notRecordable('enqueueReleaseGLObjects');
   if(!cl.WebCLDevice.prototype.enable_extensions.KHR_gl_sharing.enabled) {
     throw new WebCLException('WEBCL_EXTENSION_NOT_ENABLED');
   }
@@ -632,11 +1016,11 @@ cl.WebCLContext.prototype.createCommandQueue=function (device, properties) {
 }
 
 cl.WebCLContext.prototype.createBuffer=function (flags, size, host_ptr) {
-  if (!(arguments.length >= 2 && typeof flags === 'number' && typeof size === 'number' &&
+  if (!(arguments.length >= 2 && typeof flags === 'number' && isSize(size) &&
       (host_ptr === null || typeof host_ptr === 'undefined' || typeof host_ptr === 'object') )) {
     throw new TypeError('Expected WebCLContext.createBuffer(CLenum flags, int size, optional ArrayBuffer host_ptr)');
   }
-  return this._createBuffer(flags, size, host_ptr);
+  return this._createBuffer(flags, toSize(size), host_ptr);
 }
 
 cl.WebCLContext.prototype.createImage=function (flags, descriptor, host_ptr) {
@@ -821,7 +1205,13 @@ cl.WebCLKernel.prototype.setArg=function (index, value) {
       (typeof value === 'object') )) {
     throw new TypeError('Expected WebCLKernel.setArg(int index, WebCLBuffer | WebCLImage | WebCLSampler | ArrayBufferView value)');
   }
-  return this._setArg(index, value);
+  var ret=this._setArg(index, value);
+  // remember bound buffers, launches look for residency hints on them
+  if (checkObjectType(value, 'WebCLBuffer'))
+    (this._memArgs || (this._memArgs=[]))[index]=value;
+  else if (this._memArgs)
+    this._memArgs[index]=undefined;
+  return ret;
 }
 
 //////////////////////////////
@@ -880,10 +1270,22 @@ cl.WebCLBuffer.prototype.getGLObjectInfo=function () {
 }
 
 cl.WebCLBuffer.prototype.createSubBuffer=function (flags, origin, sizeInBytes) {
-  if (!(arguments.length === 3 && typeof flags === 'number' && typeof origin === 'number' && typeof sizeInBytes === 'number')) {
+  if (!(arguments.length === 3 && typeof flags === 'number' && isSize(origin) && isSize(sizeInBytes))) {
     throw new TypeError('Expected WebCLMemoryObject.createSubBuffer(CLenum flags, CLuint origin, CLuint sizeInBytes)');
   }
-  return this._createSubBuffer(flags, origin, sizeInBytes);
+  return this._createSubBuffer(flags, toSize(origin), toSize(sizeInBytes));
+}
+
+// Residency hint for multi-device contexts: the buffer lives on the device
+// of queue. It is migrated there now, and again after each kernel launched
+// on another queue that uses it. Pass null to drop the hint.
+cl.WebCLBuffer.prototype.setPreferredDevice=function (queue) {
+  if (!(arguments.length === 1 && (queue==null || checkObjectType(queue, 'WebCLCommandQueue')))) {
+    throw new TypeError('Expected WebCLBuffer.setPreferredDevice(WebCLCommandQueue queue)');
+  }
+  this._preferredQueue=queue || null;
+  if (queue)
+    queue.enqueueMigrateMemObjects([this], 0);
 }
 
 //////////////////////////////
@@ -1048,6 +1450,64 @@ cl.WebCLSampler.prototype.getInfo=function (param_name) {
   return this._getInfo(param_name);
 }
 
+//////////////////////////////
+// WebCLCommandStream object
+//////////////////////////////
+require('./lib/commandStream')(cl);
+global.WebCLCommandStream=cl.WebCLCommandStream;
+
+//////////////////////////////
+// WebCLCommandGraph object
+//////////////////////////////
+global.WebCLCommandGraph=cl.WebCLCommandGraph;
+global.WebCLGraphParam=cl.WebCLGraphParam;
+
+// params: values of the parameter slots, as ArrayBufferViews. Missing or null
+// entries keep the value of the previous replay.
+cl.WebCLCommandGraph.prototype.replay=function (params, queue) {
+  if (!((params==null || isArray(params)) &&
+      (queue==null || checkObjectType(queue, 'WebCLCommandQueue')))) {
+    throw new TypeError('Expected WebCLCommandGraph.replay(ArrayBufferView[] params, WebCLCommandQueue queue)');
+  }
+  return this._replay(queue || this._queue, params || []);
+}
+
+cl.WebCLCommandGraph.prototype.release=function () {
+  this._queue=null;
+  return this._release();
+}
+
+//////////////////////////////
+// WebCLBuffer streams
+//////////////////////////////
+require('./lib/streams')(cl);
+global.WebCLBufferWriteStream=cl.WebCLBufferWriteStream;
+global.WebCLBufferReadStream=cl.WebCLBufferReadStream;
+
+//////////////////////////////
+// WebCLStagingPool object
+//////////////////////////////
+require('./lib/stagingPool')(cl);
+global.WebCLStagingPool=cl.WebCLStagingPool;
+
+//////////////////////////////
+// WebCLDispatcher object
+//////////////////////////////
+require('./lib/dispatcher')(cl);
+global.WebCLDispatcher=cl.WebCLDispatcher;
+
+//////////////////////////////
+// WebCLScheduler object
+//////////////////////////////
+require('./lib/scheduler')(cl);
+global.WebCLScheduler=cl.WebCLScheduler;
+
+//////////////////////////////
+// WebCLTaskGraph object
+//////////////////////////////
+require('./lib/taskGraph')(cl);
+global.WebCLTaskGraph=cl.WebCLTaskGraph;
+
 //////////////////////////////
 // extensions
 //////////////////////////////